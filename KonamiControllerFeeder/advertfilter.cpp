@@ -0,0 +1,124 @@
+#include <cwchar>
+
+#include "advertfilter.h"
+
+struct ControllerName {
+	const wchar_t *name;
+	size_t nameLen;
+	DeviceType deviceType;
+};
+
+// Every supported name starts with a different character, so the first character picks the only candidate
+static const ControllerName controllerNames[] = {
+	{ L"IIDX Entry model", 16, DeviceType::IIDX },
+	{ L"SDVX Entry Model", 16, DeviceType::SDVX },
+	{ L"Pop'n controller", 16, DeviceType::POPN },
+	{ L"GITADORA controller", 19, DeviceType::GITADORA_GUITAR }, // TODO: Temporary until real name is known
+};
+
+struct ControllerNameTable {
+	const ControllerName *candidates[128];
+};
+
+static ControllerNameTable buildControllerNameTable() {
+	ControllerNameTable table = {};
+	for (auto &entry : controllerNames) {
+		table.candidates[entry.name[0] & 0x7f] = &entry;
+	}
+	return table;
+}
+
+static const ControllerName *getControllerNameCandidate(wchar_t first) {
+	static const ControllerNameTable table = buildControllerNameTable();
+	return (unsigned int)first < 128 ? table.candidates[(unsigned int)first] : nullptr;
+}
+
+DeviceType getDeviceTypeFromName(const wchar_t *name, size_t nameLen) {
+	if (nameLen == 0) {
+		return DeviceType::UNKNOWN;
+	}
+
+	auto entry = getControllerNameCandidate(name[0]);
+	if (entry == nullptr || entry->nameLen != nameLen || wmemcmp(entry->name, name, nameLen) != 0) {
+		return DeviceType::UNKNOWN;
+	}
+
+	return entry->deviceType;
+}
+
+static size_t getCacheSet(uint64_t address) {
+	// Fibonacci hashing, vendors hand out addresses in blocks so the low bits alone cluster badly
+	return (size_t)((address * 0x9e3779b97f4a7c15ull) >> 32) & (ADVERTISEMENT_CACHE_SETS - 1);
+}
+
+AdvertisementFilter::AdvertisementFilter() : cache(), stats(), logWindowStart(0), logWindowCount(0), suppressedLogs(0) {
+}
+
+DeviceType AdvertisementFilter::check(uint64_t address, const wchar_t *name, size_t nameLen, uint64_t now, bool &isLogged, uint64_t &suppressed) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	isLogged = false;
+	suppressed = 0;
+	stats.advertisements++;
+
+	// Several ways per set so two busy devices that hash to the same set don't keep evicting each other
+	auto set = cache[getCacheSet(address)];
+	auto oldest = &set[0];
+	for (auto way = 0; way < ADVERTISEMENT_CACHE_WAYS; way++) {
+		if (set[way].address == address && now - set[way].time < ADVERTISEMENT_CACHE_EXPIRY_NS) {
+			stats.cached++;
+			return DeviceType::UNKNOWN;
+		}
+
+		if (set[way].time < oldest->time) {
+			oldest = &set[way];
+		}
+	}
+
+	// With active scanning the name often only shows up in the scan response, so an advertisement
+	// without a name says nothing about the device and must not get it rejected
+	if (nameLen == 0) {
+		stats.unnamed++;
+		return DeviceType::UNKNOWN;
+	}
+
+	auto deviceType = getDeviceTypeFromName(name, nameLen);
+	if (deviceType != DeviceType::UNKNOWN) {
+		stats.matched++;
+		return deviceType;
+	}
+
+	stats.rejected++;
+	oldest->address = address;
+	oldest->time = now;
+
+	if (isLogAllowed(now)) {
+		isLogged = true;
+		suppressed = suppressedLogs;
+		suppressedLogs = 0;
+	}
+	else {
+		suppressedLogs++;
+	}
+
+	return DeviceType::UNKNOWN;
+}
+
+AdvertisementFilterStats AdvertisementFilter::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+bool AdvertisementFilter::isLogAllowed(uint64_t now) {
+	if (now - logWindowStart >= 1000000000ull) {
+		logWindowStart = now;
+		logWindowCount = 0;
+	}
+
+	if (logWindowCount >= ADVERTISEMENT_LOG_PER_SECOND) {
+		return false;
+	}
+
+	logWindowCount++;
+	return true;
+}
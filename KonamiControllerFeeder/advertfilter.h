@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "decoder.h"
+
+#define ADVERTISEMENT_CACHE_SETS 256 // Power of 2
+#define ADVERTISEMENT_CACHE_WAYS 4
+#define ADVERTISEMENT_CACHE_EXPIRY_NS 60000000000ull
+#define ADVERTISEMENT_LOG_PER_SECOND 5
+
+struct AdvertisementFilterStats {
+	uint64_t advertisements;
+	uint64_t matched;
+	uint64_t rejected; // Names that were looked up and didn't match
+	uint64_t cached; // Skipped without looking at the name because the address was rejected before
+	uint64_t unnamed; // Advertisements without a name, usually the part before the scan response
+};
+
+// Decides which advertisements come from a supported controller. Names are matched with a single table
+// lookup on the first character, addresses that were rejected once are remembered in a small
+// set-associative cache and "Skipping device" messages are rate limited.
+class AdvertisementFilter {
+public:
+	AdvertisementFilter();
+
+	// Returns DeviceType::UNKNOWN for anything that isn't a controller. isLogged is set when the caller
+	// should print that the device was skipped, suppressedLogs is the number of messages dropped since then.
+	DeviceType check(uint64_t address, const wchar_t *name, size_t nameLen, uint64_t now, bool &isLogged, uint64_t &suppressedLogs);
+
+	AdvertisementFilterStats getStats();
+
+private:
+	struct CacheEntry {
+		uint64_t address;
+		uint64_t time;
+	};
+
+	bool isLogAllowed(uint64_t now);
+
+	std::mutex mutex;
+	CacheEntry cache[ADVERTISEMENT_CACHE_SETS][ADVERTISEMENT_CACHE_WAYS];
+	AdvertisementFilterStats stats;
+
+	uint64_t logWindowStart;
+	uint32_t logWindowCount;
+	uint64_t suppressedLogs;
+};
+
+// Advertised names of the supported controllers
+DeviceType getDeviceTypeFromName(const wchar_t *name, size_t nameLen);
@@ -0,0 +1,26 @@
+#include <cmath>
+
+#include "axis.h"
+
+bool isValidAxisCurve(double curve) {
+	return curve > 0.0 && std::isfinite(curve);
+}
+
+void buildAxisTable(AxisTable &table, const AxisConfig &config) {
+	auto deadzone = config.deadzone < 0 ? 0 : (config.deadzone > 254 ? 254 : config.deadzone);
+	auto curve = isValidAxisCurve(config.curve) ? config.curve : 1.0;
+	auto isLinear = curve == 1.0 && deadzone == 0;
+
+	for (auto data = 0; data < 256; data++) {
+		double input = data;
+
+		if (!isLinear) {
+			// Rescale whatever is left after the deadzone back to the full input range before applying the curve
+			auto normalized = data < deadzone ? 0.0 : (double)(data - deadzone) / (255 - deadzone);
+			input = std::pow(normalized, curve) * 255.0;
+		}
+
+		// Same formula the feeder always used per packet, so the default curve is bit-identical
+		table.values[data] = (long)std::round(((input * config.sensitivity) / 255.0) * 32768.0) % 32768;
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// Both knob bytes only have 256 possible values and the axis settings are fixed at startup,
+// so the whole analog transform is precomputed and decoding an axis is a single table lookup
+struct AxisConfig {
+	double sensitivity;
+	double curve; // Response curve exponent, 1.0 is linear
+	int deadzone; // Raw values below this are treated as 0
+};
+
+struct AxisTable {
+	int32_t values[256];
+};
+
+// The curve has to be positive, anything else would raise 0 to a negative power
+bool isValidAxisCurve(double curve);
+
+// An invalid curve is treated as linear
+void buildAxisTable(AxisTable &table, const AxisConfig &config);
@@ -0,0 +1,354 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "capture.h"
+#include "controller.h"
+#include "fileio.h"
+#include "metrics.h"
+#include "output.h"
+#include "timing.h"
+#include "xorshift.h"
+
+#define BENCHMARK_WARMUP_NOTIFICATIONS 1000
+#define BENCHMARK_REPETITIONS 5
+#define BENCHMARK_NAME_LEN 64
+#define BENCHMARK_FRAME_PERIOD_NS 1000000ull // The controllers sample once per millisecond
+
+struct BenchmarkStream {
+	size_t notificationLen;
+	std::vector<unsigned char> data; // Notifications back to back, except for captures
+	std::vector<const unsigned char*> notifications;
+	std::vector<size_t> lengths;
+	std::vector<uint64_t> arrivals; // From the start of a pass, as if every packet took one frame period
+	uint64_t packets;
+};
+
+struct BenchmarkResult {
+	char name[BENCHMARK_NAME_LEN];
+	uint64_t packets;
+	double nsPerPacket;
+	double allocationsPerPacket; // Negative if allocations weren't counted
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t max;
+	uint64_t submitted; // Reports into and out of the output stage over one pass
+	uint64_t forwarded;
+};
+
+static const DeviceType benchmarkDeviceTypes[] = { DeviceType::IIDX, DeviceType::SDVX, DeviceType::POPN, DeviceType::GITADORA_GUITAR };
+
+static bool isKnobDevice(DeviceType deviceType) {
+	return deviceType == DeviceType::IIDX || deviceType == DeviceType::SDVX;
+}
+
+static void addNotification(BenchmarkStream &stream, const unsigned char *data, size_t len, size_t packets) {
+	// A notification arrives once the last packet in it was sampled
+	stream.packets += packets;
+	stream.notifications.push_back(data);
+	stream.lengths.push_back(len);
+	stream.arrivals.push_back(stream.packets * BENCHMARK_FRAME_PERIOD_NS);
+}
+
+static void buildSyntheticStream(BenchmarkStream &stream, DeviceType deviceType, size_t packetLen, size_t burst, size_t notifications) {
+	stream.notificationLen = packetLen * burst;
+	stream.data.assign(stream.notificationLen * notifications, 0);
+
+	uint32_t random = 0x4b434642;
+	uint8_t axis[2] = { 0, 128 };
+	uint16_t buttons = 0;
+	uint8_t frame = 0;
+
+	for (size_t i = 0; i < notifications * burst; i++) {
+		auto packet = &stream.data[i * packetLen];
+
+		// Knobs mostly keep turning the same way a few counts per frame, buttons change every few frames
+		for (auto &value : axis) {
+			value = (uint8_t)(value + (int)(nextRandom(random) % 7) - 2);
+		}
+
+		if (nextRandom(random) % 8 == 0) {
+			buttons ^= (uint16_t)(1 << (nextRandom(random) % 9));
+		}
+
+		if (isKnobDevice(deviceType)) {
+			packet[0] = axis[0];
+			packet[1] = deviceType == DeviceType::SDVX ? axis[1] : 0;
+			packet[2] = (uint8_t)(buttons & 0x7f);
+			packet[3] = (uint8_t)((buttons >> 7) & 0x03);
+			packet[4] = frame++;
+		}
+		else {
+			packet[0] = (uint8_t)buttons;
+			packet[1] = (uint8_t)((buttons >> 8) & 0x01);
+			packet[5] = frame++;
+		}
+	}
+
+	for (size_t i = 0; i < notifications; i++) {
+		addNotification(stream, &stream.data[i * stream.notificationLen], stream.notificationLen, burst);
+	}
+}
+
+static void runCase(BenchmarkResult &result, const char *name, DeviceType deviceType, const DecoderConfig &config, const BenchmarkStream &stream, bool isCollapsingBursts, AllocationCountFunc countAllocations) {
+	std::unique_ptr<Controller> controller(new Controller());
+	std::unique_ptr<ControllerMetrics> timing(new ControllerMetrics());
+	initController(*controller, 0, 0, deviceType, 0, config);
+	setControllerOutput(*controller, std::unique_ptr<OutputSink>(new CountingSink()), true, isCollapsingBursts);
+	resetMetrics(*timing);
+
+	auto count = stream.notifications.size();
+	auto warmup = count < BENCHMARK_WARMUP_NOTIFICATIONS ? count : BENCHMARK_WARMUP_NOTIFICATIONS;
+
+	// Arrivals keep moving forward from pass to pass so the frame clock sees a steady stream
+	// instead of the whole burst arriving at once
+	auto passArrival = getTimestampNs();
+	auto passDuration = stream.packets * BENCHMARK_FRAME_PERIOD_NS;
+
+	for (size_t i = 0; i < warmup; i++) {
+		processNotification(*controller, config, stream.notifications[i], stream.lengths[i], passArrival + stream.arrivals[i], getTimestampNs());
+	}
+	passArrival += passDuration;
+
+	// Throughput passes are only timed as a whole so the clock doesn't dominate short packets.
+	// The fastest pass is kept, anything slower was disturbed by something outside the feeder.
+	// Allocations are counted over the first pass only.
+	uint64_t elapsed = 0;
+	uint64_t allocations = 0;
+	auto &output = *controller->outputSink;
+
+	for (auto repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+		auto allocationsBefore = countAllocations != nullptr ? countAllocations() : 0;
+		auto submittedBefore = output.submitted;
+		auto forwardedBefore = output.forwarded;
+
+		auto start = getTimestampNs();
+		for (size_t i = 0; i < count; i++) {
+			processNotification(*controller, config, stream.notifications[i], stream.lengths[i], passArrival + stream.arrivals[i], start);
+		}
+		auto passElapsed = getTimestampNs() - start;
+		passArrival += passDuration;
+
+		if (repetition == 0 && countAllocations != nullptr) {
+			allocations = countAllocations() - allocationsBefore;
+		}
+
+		if (repetition == 0) {
+			result.submitted = output.submitted - submittedBefore;
+			result.forwarded = output.forwarded - forwardedBefore;
+		}
+
+		if (repetition == 0 || passElapsed < elapsed) {
+			elapsed = passElapsed;
+		}
+	}
+
+	// Latency pass, every notification is timed on its own to get the tail
+	for (size_t i = 0; i < count; i++) {
+		auto notificationStart = getTimestampNs();
+		processNotification(*controller, config, stream.notifications[i], stream.lengths[i], passArrival + stream.arrivals[i], notificationStart);
+		recordLatency(*timing, getTimestampNs() - notificationStart);
+	}
+
+	auto snapshot = getMetricsSnapshot(*timing);
+
+	snprintf(result.name, sizeof(result.name), "%s", name);
+	result.packets = stream.packets;
+	result.nsPerPacket = stream.packets > 0 ? (double)elapsed / stream.packets : 0.0;
+	result.allocationsPerPacket = countAllocations == nullptr ? -1.0 : stream.packets > 0 ? (double)allocations / stream.packets : 0.0;
+	result.p50 = snapshot.latencyP50;
+	result.p99 = snapshot.latencyP99;
+	result.max = snapshot.latencyMax;
+}
+
+// Every case runs with duplicate suppression only, and with bursts collapsed on top of that
+static void runOutputModes(std::vector<BenchmarkResult> &results, const char *name, DeviceType deviceType, const DecoderConfig &config, const BenchmarkStream &stream, AllocationCountFunc countAllocations) {
+	BenchmarkResult result;
+	runCase(result, name, deviceType, config, stream, false, countAllocations);
+	results.push_back(result);
+
+	auto collapseName = std::string(name) + "-collapse";
+	runCase(result, collapseName.c_str(), deviceType, config, stream, true, countAllocations);
+	results.push_back(result);
+}
+
+static void runCaptureCases(std::vector<BenchmarkResult> &results, const wchar_t *path, const DecoderConfig &analogConfig, AllocationCountFunc countAllocations) {
+	CaptureReader reader;
+	if (!openCaptureReader(reader, path)) {
+		printf("Failed to open capture file for the benchmark\n");
+		return;
+	}
+
+	BenchmarkStream streams[sizeof(benchmarkDeviceTypes) / sizeof(benchmarkDeviceTypes[0])] = {};
+
+	CaptureRecord record;
+	while (readCaptureRecord(reader, record)) {
+		for (size_t i = 0; i < sizeof(benchmarkDeviceTypes) / sizeof(benchmarkDeviceTypes[0]); i++) {
+			if (record.deviceType == benchmarkDeviceTypes[i]) {
+				auto packetLen = getPacketDecoder(record.deviceType, analogConfig).packetLen;
+				addNotification(streams[i], record.data, record.len, record.len / packetLen);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(benchmarkDeviceTypes) / sizeof(benchmarkDeviceTypes[0]); i++) {
+		if (streams[i].notifications.empty()) {
+			continue;
+		}
+
+		char name[BENCHMARK_NAME_LEN];
+		snprintf(name, sizeof(name), "capture-%s", getDeviceTypeName(benchmarkDeviceTypes[i]));
+
+		runOutputModes(results, name, benchmarkDeviceTypes[i], analogConfig, streams[i], countAllocations);
+	}
+
+	closeCaptureReader(reader);
+}
+
+static bool loadBaseline(const wchar_t *path, std::vector<BenchmarkResult> &baseline) {
+	// One case per line: name ns/packet allocations/packet p50 p99 max
+	auto file = openFile(path, L"r");
+	if (file == nullptr) {
+		return false;
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		BenchmarkResult result = {};
+
+		auto separator = strchr(line, ' ');
+		if (separator == nullptr || separator - line >= BENCHMARK_NAME_LEN) {
+			continue;
+		}
+
+		memcpy(result.name, line, separator - line);
+
+		char *end;
+		result.nsPerPacket = strtod(separator + 1, &end);
+		result.allocationsPerPacket = strtod(end, &end);
+		result.p50 = strtoull(end, &end, 10);
+		result.p99 = strtoull(end, &end, 10);
+		result.max = strtoull(end, &end, 10);
+
+		baseline.push_back(result);
+	}
+
+	fclose(file);
+	return true;
+}
+
+static bool saveBaseline(const wchar_t *path, const std::vector<BenchmarkResult> &results) {
+	auto file = openFile(path, L"w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	for (auto &result : results) {
+		fprintf(file, "%s %.3f %.6f %llu %llu %llu\n", result.name, result.nsPerPacket, result.allocationsPerPacket, (unsigned long long)result.p50, (unsigned long long)result.p99, (unsigned long long)result.max);
+	}
+
+	fclose(file);
+	return true;
+}
+
+int runBenchmark(const BenchmarkOptions &options, const DecoderConfig &baseConfig) {
+	DecoderConfig analogConfig = baseConfig;
+	analogConfig.isDigital = false;
+	buildDecoderTables(analogConfig);
+
+	DecoderConfig digitalConfig = baseConfig;
+	digitalConfig.isDigital = true;
+	buildDecoderTables(digitalConfig);
+
+	std::vector<BenchmarkResult> results;
+
+	for (auto deviceType : benchmarkDeviceTypes) {
+		// The button-only controllers don't have a digital mode
+		auto modes = isKnobDevice(deviceType) ? 2 : 1;
+
+		for (auto mode = 0; mode < modes; mode++) {
+			auto &config = mode == 0 ? analogConfig : digitalConfig;
+			auto packetLen = getPacketDecoder(deviceType, config).packetLen;
+
+			for (size_t burst = 1; burst <= BENCHMARK_MAX_BURST; burst++) {
+				BenchmarkStream stream = {};
+				buildSyntheticStream(stream, deviceType, packetLen, burst, options.notifications);
+
+				char name[BENCHMARK_NAME_LEN];
+				snprintf(name, sizeof(name), "%s-%s-burst%zu", getDeviceTypeName(deviceType), mode == 0 ? "analog" : "digital", burst);
+
+				runOutputModes(results, name, deviceType, config, stream, options.countAllocations);
+			}
+		}
+	}
+
+	if (options.capturePath != nullptr) {
+		runCaptureCases(results, options.capturePath, analogConfig, options.countAllocations);
+	}
+
+	std::vector<BenchmarkResult> baseline;
+	auto hasBaseline = false;
+	if (options.baselinePath != nullptr) {
+		hasBaseline = loadBaseline(options.baselinePath, baseline);
+		if (!hasBaseline) {
+			printf("Failed to read the benchmark baseline\n");
+		}
+	}
+
+	printf("%-40s %10s %10s %12s %10s %10s %10s %10s %10s %s\n", "case", "packets", "ns/packet", "allocs/packet", "p50 ns", "p99 ns", "max ns", "submitted", "forwarded", hasBaseline ? "vs baseline" : "");
+
+	auto regressions = 0;
+	for (auto &result : results) {
+		char allocations[16];
+		if (result.allocationsPerPacket < 0) {
+			snprintf(allocations, sizeof(allocations), "n/a");
+		}
+		else {
+			snprintf(allocations, sizeof(allocations), "%.3f", result.allocationsPerPacket);
+		}
+
+		printf("%-40s %10llu %10.1f %12s %10llu %10llu %10llu %10llu %10llu",
+			result.name,
+			(unsigned long long)result.packets,
+			result.nsPerPacket,
+			allocations,
+			(unsigned long long)result.p50,
+			(unsigned long long)result.p99,
+			(unsigned long long)result.max,
+			(unsigned long long)result.submitted,
+			(unsigned long long)result.forwarded);
+
+		for (auto &base : baseline) {
+			if (strcmp(base.name, result.name) != 0) {
+				continue;
+			}
+
+			auto change = base.nsPerPacket > 0 ? (result.nsPerPacket / base.nsPerPacket - 1.0) * 100.0 : 0.0;
+			auto isAllocating = base.allocationsPerPacket >= 0 && result.allocationsPerPacket > base.allocationsPerPacket;
+			auto isRegression = change > options.threshold || isAllocating;
+			printf(" %+.1f%%%s", change, isRegression ? " REGRESSION" : "");
+
+			if (isRegression) {
+				regressions++;
+			}
+		}
+
+		printf("\n");
+	}
+
+	if (options.savePath != nullptr && !saveBaseline(options.savePath, results)) {
+		printf("Failed to write the benchmark baseline\n");
+		return -1;
+	}
+
+	if (regressions > 0) {
+		printf("%d case(s) regressed by more than %.1f%% or allocate more than the baseline\n", regressions, options.threshold);
+		return 1;
+	}
+
+	return 0;
+}
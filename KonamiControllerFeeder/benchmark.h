@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "decoder.h"
+
+#define BENCHMARK_DEFAULT_NOTIFICATIONS 20000
+#define BENCHMARK_DEFAULT_THRESHOLD 10.0 // Percent
+#define BENCHMARK_MAX_BURST 8
+
+// Allocations made so far by the calling thread
+typedef uint64_t (*AllocationCountFunc)();
+
+struct BenchmarkOptions {
+	const wchar_t *capturePath; // Also benchmark the recorded stream, nullptr for synthetic streams only
+	const wchar_t *baselinePath; // Compare against a previously saved run
+	const wchar_t *savePath; // Save this run as a new baseline
+	double threshold; // Allowed ns/packet increase over the baseline, in percent
+	size_t notifications; // Per case
+	AllocationCountFunc countAllocations; // nullptr if global operator new isn't instrumented, see tests/benchmain.cpp
+};
+
+// Runs the notification hot path (decode, axis tables, digital motion, output stage) for every device
+// type, analog and digital mode and burst size, without any Bluetooth or vJoy involved. Every case runs with
+// duplicate suppression only and again with bursts collapsed.
+// Returns 0 on success, 1 if a case regressed against the baseline and -1 on errors.
+int runBenchmark(const BenchmarkOptions &options, const DecoderConfig &baseConfig);
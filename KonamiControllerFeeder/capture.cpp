@@ -0,0 +1,240 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "capture.h"
+#include "fileio.h"
+#include "timing.h"
+
+static const char captureMagic[6] = { 'K', 'C', 'F', 'C', 'A', 'P' };
+
+static void writeLE16(unsigned char *dst, uint16_t value) {
+	dst[0] = value & 0xff;
+	dst[1] = (value >> 8) & 0xff;
+}
+
+static void writeLE64(unsigned char *dst, uint64_t value) {
+	for (auto i = 0; i < 8; i++) {
+		dst[i] = (value >> (i * 8)) & 0xff;
+	}
+}
+
+static uint16_t readLE16(const unsigned char *src) {
+	return src[0] | (src[1] << 8);
+}
+
+static uint64_t readLE64(const unsigned char *src) {
+	uint64_t value = 0;
+	for (auto i = 0; i < 8; i++) {
+		value |= (uint64_t)src[i] << (i * 8);
+	}
+	return value;
+}
+
+bool openCaptureWriter(CaptureWriter &writer, const wchar_t *path) {
+	writer.file = openFile(path, L"wb");
+
+	if (writer.file == nullptr) {
+		return false;
+	}
+
+	// Keep most writes in memory so the notification handler rarely touches the disk
+	setvbuf(writer.file, nullptr, _IOFBF, 1 << 16);
+
+	unsigned char header[CAPTURE_FILE_HEADER_LEN];
+	memcpy(header, captureMagic, sizeof(captureMagic));
+	writeLE16(header + 6, CAPTURE_VERSION);
+	fwrite(header, 1, sizeof(header), writer.file);
+
+	return true;
+}
+
+void writeCaptureRecord(CaptureWriter &writer, uint64_t timestamp, DeviceType deviceType, uint8_t controllerIdx, const unsigned char *data, size_t len) {
+	if (writer.file == nullptr) {
+		return;
+	}
+
+	if (len > CAPTURE_MAX_PAYLOAD_LEN) {
+		len = CAPTURE_MAX_PAYLOAD_LEN;
+	}
+
+	// Several controllers can record at the same time, so each record has to go out in a single write
+	unsigned char record[CAPTURE_RECORD_HEADER_LEN + CAPTURE_MAX_PAYLOAD_LEN];
+	writeLE64(record, timestamp);
+	writeLE16(record + 8, (uint16_t)len);
+	record[10] = (unsigned char)deviceType;
+	record[11] = controllerIdx;
+	memcpy(record + CAPTURE_RECORD_HEADER_LEN, data, len);
+
+	fwrite(record, 1, CAPTURE_RECORD_HEADER_LEN + len, writer.file);
+}
+
+void flushCaptureWriter(CaptureWriter &writer) {
+	if (writer.file != nullptr) {
+		fflush(writer.file);
+	}
+}
+
+void closeCaptureWriter(CaptureWriter &writer) {
+	if (writer.file != nullptr) {
+		fclose(writer.file);
+		writer.file = nullptr;
+	}
+}
+
+bool openCaptureReader(CaptureReader &reader, const wchar_t *path) {
+	reader.data = nullptr;
+	reader.size = 0;
+	reader.offset = CAPTURE_FILE_HEADER_LEN;
+	reader.fileHandle = nullptr;
+	reader.mappingHandle = nullptr;
+
+#ifdef _WIN32
+	auto file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < CAPTURE_FILE_HEADER_LEN) {
+		CloseHandle(file);
+		return false;
+	}
+
+	auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	reader.data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (reader.data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	reader.size = (size_t)fileSize.QuadPart;
+	reader.fileHandle = file;
+	reader.mappingHandle = mapping;
+#else
+	std::string narrowedPath;
+	if (!narrowPath(path, narrowedPath)) {
+		return false;
+	}
+
+	auto fd = open(narrowedPath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < CAPTURE_FILE_HEADER_LEN) {
+		close(fd);
+		return false;
+	}
+
+	auto mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+
+	reader.data = (const unsigned char*)mapping;
+	reader.size = (size_t)st.st_size;
+#endif
+
+	if (memcmp(reader.data, captureMagic, sizeof(captureMagic)) != 0 || readLE16(reader.data + 6) != CAPTURE_VERSION) {
+		closeCaptureReader(reader);
+		return false;
+	}
+
+	return true;
+}
+
+bool readCaptureRecord(CaptureReader &reader, CaptureRecord &record) {
+	if (reader.data == nullptr || reader.offset + CAPTURE_RECORD_HEADER_LEN > reader.size) {
+		return false;
+	}
+
+	auto header = reader.data + reader.offset;
+	auto len = readLE16(header + 8);
+
+	if (reader.offset + CAPTURE_RECORD_HEADER_LEN + len > reader.size) {
+		// Truncated record at the end of the file, probably from the feeder being killed while recording
+		return false;
+	}
+
+	record.timestamp = readLE64(header);
+	record.len = len;
+	record.deviceType = (DeviceType)header[10];
+	record.controllerIdx = header[11];
+	record.data = header + CAPTURE_RECORD_HEADER_LEN;
+
+	reader.offset += CAPTURE_RECORD_HEADER_LEN + len;
+
+	return true;
+}
+
+void closeCaptureReader(CaptureReader &reader) {
+	if (reader.data == nullptr) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(reader.data);
+	CloseHandle((HANDLE)reader.mappingHandle);
+	CloseHandle((HANDLE)reader.fileHandle);
+#else
+	munmap((void*)reader.data, reader.size);
+#endif
+
+	reader.data = nullptr;
+	reader.size = 0;
+}
+
+CaptureReplayStats replayCapture(CaptureReader &reader, bool isRealtime, CaptureReplayCallback callback, void *context) {
+	CaptureReplayStats stats = {};
+	CaptureRecord record;
+
+	auto startTime = getTimestampNs();
+	uint64_t firstRecordTime = 0;
+
+	while (readCaptureRecord(reader, record)) {
+		if (stats.notifications == 0) {
+			firstRecordTime = record.timestamp;
+		}
+
+		auto targetTime = startTime + (record.timestamp - firstRecordTime);
+		record.timestamp = targetTime;
+
+		if (isRealtime) {
+			auto now = getTimestampNs();
+
+			if (targetTime > now) {
+				std::this_thread::sleep_for(std::chrono::nanoseconds(targetTime - now));
+			}
+		}
+
+		stats.notifications++;
+		stats.bytes += record.len;
+
+		if (!callback(context, record)) {
+			break;
+		}
+	}
+
+	stats.elapsedNs = getTimestampNs() - startTime;
+
+	return stats;
+}
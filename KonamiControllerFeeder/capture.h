@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "decoder.h"
+
+/*
+Capture file format, all values little endian:
+
+File header (8 bytes):
+"KCFCAP" magic followed by a 16-bit version
+
+Each record (12 byte header + payload):
+uint64 timestamp in nanoseconds from the host monotonic clock
+uint16 payload length
+uint8  device type
+uint8  controller index
+payload = raw notification bytes exactly as received
+*/
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_FILE_HEADER_LEN 8
+#define CAPTURE_RECORD_HEADER_LEN 12
+#define CAPTURE_MAX_PAYLOAD_LEN 512 // Largest possible GATT attribute value
+
+struct CaptureRecord {
+	uint64_t timestamp;
+	DeviceType deviceType;
+	uint8_t controllerIdx;
+	uint16_t len;
+	const unsigned char *data; // Points into the mapped file
+};
+
+struct CaptureWriter {
+	FILE *file;
+};
+
+struct CaptureReader {
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+	void *fileHandle;
+	void *mappingHandle;
+};
+
+// Returns false from the callback to stop the replay early
+typedef bool (*CaptureReplayCallback)(void *context, const CaptureRecord &record);
+
+struct CaptureReplayStats {
+	uint64_t notifications;
+	uint64_t bytes;
+	uint64_t elapsedNs;
+};
+
+bool openCaptureWriter(CaptureWriter &writer, const wchar_t *path);
+void writeCaptureRecord(CaptureWriter &writer, uint64_t timestamp, DeviceType deviceType, uint8_t controllerIdx, const unsigned char *data, size_t len);
+void flushCaptureWriter(CaptureWriter &writer);
+void closeCaptureWriter(CaptureWriter &writer);
+
+bool openCaptureReader(CaptureReader &reader, const wchar_t *path);
+bool readCaptureRecord(CaptureReader &reader, CaptureRecord &record);
+void closeCaptureReader(CaptureReader &reader);
+
+// Feed every record to the callback, either at the recorded pace or as fast as possible. Record
+// timestamps are moved onto the host clock as if the capture had started when the replay did, so they
+// stay the same no matter how fast the replay runs.
+CaptureReplayStats replayCapture(CaptureReader &reader, bool isRealtime, CaptureReplayCallback callback, void *context);
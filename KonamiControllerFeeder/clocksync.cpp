@@ -0,0 +1,117 @@
+#include <cmath>
+
+#include "clocksync.h"
+
+void resetClockSync(ClockSync &sync) {
+	sync = ClockSync();
+}
+
+double getClockSyncPeriod(const ClockSync &sync) {
+	if (sync.samples < CLOCKSYNC_MIN_SAMPLES || sync.sxx <= 0.0) {
+		return 0.0;
+	}
+
+	return sync.sxy / sync.sxx;
+}
+
+static int64_t unwrapFrame(ClockSync &sync, uint8_t frame, uint64_t arrival, bool &isSilenceEnded) {
+	auto delta = (uint8_t)(frame - sync.lastFrame);
+	int64_t forward = delta;
+
+	// Anything that looks like a big jump is normally an older packet arriving late
+	auto isOlder = delta >= 128;
+	isSilenceEnded = false;
+
+	// After a long silence the counter may have wrapped any number of times, the host clock tells how many
+	auto period = getClockSyncPeriod(sync);
+	if (period > 0.0 && arrival > sync.lastArrival) {
+		auto expected = (arrival - sync.lastArrival) / period;
+		if (expected >= 128.0) {
+			auto wraps = (int64_t)std::floor((expected - forward) / 256.0 + 0.5);
+			if (wraps > 0) {
+				forward += 256 * wraps;
+			}
+			isOlder = false;
+			isSilenceEnded = true;
+		}
+	}
+
+	if (isOlder) {
+		return sync.frameIndex - (256 - delta);
+	}
+
+	sync.frameIndex += forward;
+	sync.lastFrame = frame;
+	sync.lastArrival = arrival;
+	return sync.frameIndex;
+}
+
+uint64_t updateClockSync(ClockSync &sync, uint8_t frame, uint64_t arrival) {
+	if (!sync.isInitialized) {
+		sync.isInitialized = true;
+		sync.lastFrame = frame;
+		sync.frameIndex = 0;
+		sync.lastArrival = arrival;
+		sync.originFrame = 0;
+		sync.originTime = arrival;
+	}
+
+	auto isSilenceEnded = false;
+	auto index = unwrapFrame(sync, frame, arrival, isSilenceEnded);
+	auto x = (double)(index - sync.originFrame);
+	auto y = (double)(int64_t)(arrival - sync.originTime);
+
+	// The phase can't be trusted after a long silence (the controller may also have restarted its
+	// counter), so the line is moved through the new packet keeping the period, and the envelope starts over
+	if (isSilenceEnded) {
+		sync.meanX = x;
+		sync.meanY = y;
+	}
+
+	// Exponentially weighted running mean and covariance (West's algorithm with a decay)
+	auto decay = 1.0 - CLOCKSYNC_DECAY;
+	sync.samples++;
+	sync.weightSum = sync.weightSum * decay + 1.0;
+
+	auto dx = x - sync.meanX;
+	auto dy = y - sync.meanY;
+	sync.meanX += dx / sync.weightSum;
+	sync.meanY += dy / sync.weightSum;
+	sync.sxx = sync.sxx * decay + dx * (x - sync.meanX);
+	sync.sxy = sync.sxy * decay + dx * (y - sync.meanY);
+
+	auto period = getClockSyncPeriod(sync);
+	if (period <= 0.0) {
+		sync.lastTimestamp = arrival;
+		return arrival;
+	}
+
+	auto predicted = sync.meanY + period * (x - sync.meanX);
+	auto residual = y - predicted;
+
+	if (sync.samples == CLOCKSYNC_MIN_SAMPLES || isSilenceEnded) {
+		sync.envelope = residual;
+	}
+	else {
+		sync.envelope = std::fmin(residual, sync.envelope + CLOCKSYNC_ENVELOPE_CREEP_NS);
+	}
+
+	// A packet can't have happened after it arrived
+	auto timestamp = predicted + sync.envelope;
+	if (timestamp > y) {
+		timestamp = y;
+	}
+
+	auto ret = sync.originTime + (uint64_t)(int64_t)std::llround(timestamp);
+
+	// A lower envelope can jump down, which must not make consumers like the digital motion hold see time
+	// going backwards. Late packets are older than the newest one anyway and are left alone.
+	if (index == sync.frameIndex) {
+		if (ret < sync.lastTimestamp) {
+			ret = sync.lastTimestamp;
+		}
+		sync.lastTimestamp = ret;
+	}
+
+	return ret;
+}
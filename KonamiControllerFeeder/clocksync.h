@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#define CLOCKSYNC_MIN_SAMPLES 32
+#define CLOCKSYNC_DECAY (1.0 / 4096.0) // Weight lost by older samples on every new one
+#define CLOCKSYNC_ENVELOPE_CREEP_NS 500.0
+
+// Maps the 8-bit frame counter of a controller onto the host monotonic clock.
+// The counter is unwrapped into a 64-bit frame index, and an exponentially weighted linear regression
+// of arrival time against frame index gives the frame period including drift between the two clocks.
+// Arrival times only ever lag the real event (connection interval, batching, scheduling), so the
+// regression line is shifted down to the lower envelope of the residuals, which slowly creeps back up
+// so it can follow a link whose minimum delay got longer.
+struct ClockSync {
+	bool isInitialized;
+	uint8_t lastFrame;
+	int64_t frameIndex; // Unwrapped frame counter of the newest packet seen
+	uint64_t lastArrival;
+	uint64_t lastTimestamp; // Reconstructed time of the newest packet, timestamps never go backwards
+
+	// Regression origin, keeps the values small enough for doubles
+	int64_t originFrame;
+	uint64_t originTime;
+
+	uint64_t samples;
+	double weightSum;
+	double meanX;
+	double meanY;
+	double sxx;
+	double sxy;
+	double envelope; // Smallest recent residual, ns
+};
+
+void resetClockSync(ClockSync &sync);
+
+// Call for every packet in the order they were received, all packets of one notification share the
+// arrival time. Returns the reconstructed host time of the packet, or the arrival time until enough
+// packets have been seen to estimate the frame period.
+uint64_t updateClockSync(ClockSync &sync, uint8_t frame, uint64_t arrival);
+
+// Nanoseconds per controller frame, 0 while unknown
+double getClockSyncPeriod(const ClockSync &sync);
@@ -0,0 +1,416 @@
+#include <cstdio>
+#include <cstring>
+
+#include "connection.h"
+#include "controller.h"
+#include "fileio.h"
+
+static const DeviceType cacheDeviceTypes[] = { DeviceType::IIDX, DeviceType::SDVX, DeviceType::POPN, DeviceType::GITADORA_GUITAR };
+
+static void formatAddress(uint64_t address, char *str, size_t len) {
+	snprintf(str, len, "%02x:%02x:%02x:%02x:%02x:%02x",
+		(unsigned int)((address >> 40) & 0xff),
+		(unsigned int)((address >> 32) & 0xff),
+		(unsigned int)((address >> 24) & 0xff),
+		(unsigned int)((address >> 16) & 0xff),
+		(unsigned int)((address >> 8) & 0xff),
+		(unsigned int)(address & 0xff));
+}
+
+const char *getConnectionStateName(ConnectionState state) {
+	switch (state) {
+	case CONNECTION_SCANNING:
+		return "scanning";
+	case CONNECTION_VALIDATING:
+		return "validating";
+	case CONNECTION_SUBSCRIBING:
+		return "subscribing";
+	case CONNECTION_STREAMING:
+		return "streaming";
+	case CONNECTION_LOST:
+		return "lost";
+	case CONNECTION_BACKOFF:
+		return "backoff";
+	default:
+		return "unknown";
+	}
+}
+
+void getDefaultConnectionConfig(ConnectionConfig &config) {
+	config.backoffMinNs = CONNECTION_DEFAULT_BACKOFF_MIN_MS * 1000000ull;
+	config.backoffMaxNs = CONNECTION_DEFAULT_BACKOFF_MAX_MS * 1000000ull;
+	config.timeoutNs = CONNECTION_DEFAULT_TIMEOUT_MS * 1000000ull;
+	config.directAttempts = CONNECTION_DEFAULT_DIRECT_ATTEMPTS;
+	config.cachePath.clear();
+}
+
+bool loadConnectionCache(const wchar_t *path, std::vector<KnownController> &controllers) {
+	// One controller per line: "aa:bb:cc:dd:ee:ff IIDX"
+	auto file = openFile(path, L"r");
+	if (file == nullptr) {
+		return false;
+	}
+
+	char line[128];
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		auto separator = strchr(line, ' ');
+		if (separator == nullptr || separator - line != 17) {
+			continue;
+		}
+
+		wchar_t addressStr[18];
+		for (auto i = 0; i < 17; i++) {
+			addressStr[i] = (wchar_t)(unsigned char)line[i];
+		}
+		addressStr[17] = 0;
+
+		KnownController controller = { 0, DeviceType::UNKNOWN };
+		if (!parseBluetoothAddress(addressStr, controller.address)) {
+			continue;
+		}
+
+		auto typeName = separator + 1;
+		typeName[strcspn(typeName, "\r\n")] = 0;
+
+		for (auto deviceType : cacheDeviceTypes) {
+			if (strcmp(typeName, getDeviceTypeName(deviceType)) == 0) {
+				controller.deviceType = deviceType;
+			}
+		}
+
+		if (controller.deviceType != DeviceType::UNKNOWN) {
+			controllers.push_back(controller);
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool saveConnectionCache(const wchar_t *path, const std::vector<KnownController> &controllers) {
+	auto file = openFile(path, L"w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	for (auto &controller : controllers) {
+		char addressStr[18];
+		formatAddress(controller.address, addressStr, sizeof(addressStr));
+		fprintf(file, "%s %s\n", addressStr, getDeviceTypeName(controller.deviceType));
+	}
+
+	fclose(file);
+	return true;
+}
+
+ConnectionManager::ConnectionManager(ConnectionTransport *transport, const ConnectionConfig &config) : transport(transport), config(config) {
+}
+
+void ConnectionManager::start(uint64_t now) {
+	std::vector<KnownController> known;
+	if (config.cachePath.empty() || !loadConnectionCache(config.cachePath.c_str(), known)) {
+		return;
+	}
+
+	std::vector<Action> actions;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto &controller : known) {
+			if (findConnection(controller.address) != nullptr) {
+				continue;
+			}
+
+			Connection connection = {};
+			connection.address = controller.address;
+			connection.deviceType = controller.deviceType;
+			connection.state = CONNECTION_SCANNING;
+			connection.isCached = true;
+			connections.push_back(connection);
+
+			char addressStr[18];
+			formatAddress(controller.address, addressStr, sizeof(addressStr));
+			printf("Connecting to cached %s controller %s\n", getDeviceTypeName(controller.deviceType), addressStr);
+
+			beginAttempt(connections.back(), now, actions);
+		}
+	}
+
+	runActions(actions);
+}
+
+void ConnectionManager::onAdvertisement(uint64_t address, DeviceType deviceType, uint64_t now) {
+	std::vector<Action> actions;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto connection = findConnection(address);
+		if (connection == nullptr) {
+			Connection newConnection = {};
+			newConnection.address = address;
+			newConnection.deviceType = deviceType;
+			newConnection.state = CONNECTION_SCANNING;
+			connections.push_back(newConnection);
+			connection = &connections.back();
+		}
+
+		// The controller is advertising so it's worth trying straight away, even in the middle of a backoff
+		if (connection->state == CONNECTION_SCANNING || connection->state == CONNECTION_BACKOFF) {
+			beginAttempt(*connection, now, actions);
+		}
+	}
+
+	runActions(actions);
+}
+
+void ConnectionManager::onValidated(uint64_t address, uint32_t attempt, bool isSuccess, uint64_t now) {
+	std::vector<Action> actions;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto connection = findConnection(address);
+		if (connection == nullptr || connection->attempt != attempt || connection->state != CONNECTION_VALIDATING) {
+			return;
+		}
+
+		if (!isSuccess) {
+			failAttempt(*connection, "target service not found", now, actions);
+		}
+		else {
+			setState(*connection, CONNECTION_SUBSCRIBING, now);
+
+			Action action = { Action::SUBSCRIBE, address, connection->deviceType, attempt };
+			actions.push_back(action);
+		}
+	}
+
+	runActions(actions);
+}
+
+void ConnectionManager::onSubscribed(uint64_t address, uint32_t attempt, bool isSuccess, uint64_t now) {
+	std::vector<Action> actions;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto connection = findConnection(address);
+		if (connection == nullptr || connection->attempt != attempt || connection->state != CONNECTION_SUBSCRIBING) {
+			return;
+		}
+
+		// On success the connection stays in subscribing until the first report shows up
+		if (!isSuccess) {
+			failAttempt(*connection, "failed to enable notifications", now, actions);
+		}
+	}
+
+	runActions(actions);
+}
+
+void ConnectionManager::onFirstReport(uint64_t address, uint32_t attempt, uint64_t now) {
+	std::vector<Action> actions;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto connection = findConnection(address);
+		if (connection == nullptr || connection->attempt != attempt || connection->state != CONNECTION_SUBSCRIBING) {
+			return;
+		}
+
+		connection->timeToFirstReportNs = now - connection->attemptTime;
+		connection->failures = 0;
+		setState(*connection, CONNECTION_STREAMING, now);
+
+		char addressStr[18];
+		formatAddress(address, addressStr, sizeof(addressStr));
+		printf("%s controller %s streaming, first report %.1f ms after connecting\n", getDeviceTypeName(connection->deviceType), addressStr, connection->timeToFirstReportNs / 1000000.0);
+
+		if (!connection->isCached && !config.cachePath.empty()) {
+			connection->isCached = true;
+
+			Action action = { Action::SAVE_CACHE, address, connection->deviceType, attempt };
+			actions.push_back(action);
+		}
+	}
+
+	runActions(actions);
+}
+
+void ConnectionManager::onLinkLost(uint64_t address, uint32_t attempt, uint64_t now) {
+	std::vector<Action> actions;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto connection = findConnection(address);
+		if (connection == nullptr || connection->attempt != attempt || connection->state == CONNECTION_SCANNING || connection->state == CONNECTION_BACKOFF || connection->state == CONNECTION_LOST) {
+			return;
+		}
+
+		connection->reconnects++;
+		failAttempt(*connection, "link lost", now, actions);
+	}
+
+	runActions(actions);
+}
+
+bool ConnectionManager::isCurrentAttempt(uint64_t address, uint32_t attempt) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto connection = findConnection(address);
+	return connection != nullptr && connection->attempt == attempt && connection->state == CONNECTION_VALIDATING;
+}
+
+void ConnectionManager::update(uint64_t now) {
+	std::vector<Action> actions;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto &connection : connections) {
+			switch (connection.state) {
+			case CONNECTION_VALIDATING:
+			case CONNECTION_SUBSCRIBING:
+				if (now - connection.stateTime >= config.timeoutNs) {
+					failAttempt(connection, "timed out", now, actions);
+				}
+				break;
+			case CONNECTION_BACKOFF:
+				if (now >= connection.retryTime) {
+					beginAttempt(connection, now, actions);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	runActions(actions);
+}
+
+bool ConnectionManager::getConnectionInfo(uint64_t address, ConnectionInfo &info) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto connection = findConnection(address);
+	if (connection == nullptr) {
+		return false;
+	}
+
+	info.address = connection->address;
+	info.deviceType = connection->deviceType;
+	info.state = connection->state;
+	info.attempts = connection->attempt;
+	info.reconnects = connection->reconnects;
+	info.timeToFirstReportNs = connection->timeToFirstReportNs;
+	return true;
+}
+
+size_t ConnectionManager::getConnectionCount() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return connections.size();
+}
+
+ConnectionManager::Connection *ConnectionManager::findConnection(uint64_t address) {
+	for (auto &connection : connections) {
+		if (connection.address == address) {
+			return &connection;
+		}
+	}
+
+	return nullptr;
+}
+
+void ConnectionManager::setState(Connection &connection, ConnectionState state, uint64_t now) {
+	connection.state = state;
+	connection.stateTime = now;
+}
+
+void ConnectionManager::beginAttempt(Connection &connection, uint64_t now, std::vector<Action> &actions) {
+	connection.attempt++;
+	connection.attemptTime = now;
+	setState(connection, CONNECTION_VALIDATING, now);
+
+	Action action = { Action::VALIDATE, connection.address, connection.deviceType, connection.attempt };
+	actions.push_back(action);
+}
+
+void ConnectionManager::failAttempt(Connection &connection, const char *reason, uint64_t now, std::vector<Action> &actions) {
+	char addressStr[18];
+	formatAddress(connection.address, addressStr, sizeof(addressStr));
+
+	// Lost only lasts until the transport has been told to let go of the device
+	setState(connection, CONNECTION_LOST, now);
+
+	Action action = { Action::DISCONNECT, connection.address, connection.deviceType, connection.attempt };
+	actions.push_back(action);
+
+	connection.failures++;
+
+	// Controllers that keep failing are probably switched off, so stop trying until they advertise again
+	if (connection.failures >= (uint32_t)config.directAttempts) {
+		printf("%s controller %s %s, waiting for it to advertise\n", getDeviceTypeName(connection.deviceType), addressStr, reason);
+		// The next advertisement gets a full round of direct attempts starting without backoff
+		connection.failures = 0;
+		setState(connection, CONNECTION_SCANNING, now);
+		return;
+	}
+
+	auto backoff = getBackoff(connection.failures);
+	printf("%s controller %s %s, reconnecting in %.0f ms\n", getDeviceTypeName(connection.deviceType), addressStr, reason, backoff / 1000000.0);
+
+	setState(connection, CONNECTION_BACKOFF, now);
+	connection.retryTime = now + backoff;
+}
+
+uint64_t ConnectionManager::getBackoff(uint32_t failures) const {
+	// The first retry after losing a working link is immediate, then the delay doubles up to the maximum
+	if (failures <= 1) {
+		return 0;
+	}
+
+	auto backoff = config.backoffMinNs;
+	for (uint32_t i = 2; i < failures && backoff < config.backoffMaxNs; i++) {
+		backoff *= 2;
+	}
+
+	return backoff < config.backoffMaxNs ? backoff : config.backoffMaxNs;
+}
+
+void ConnectionManager::runActions(const std::vector<Action> &actions) {
+	for (auto &action : actions) {
+		switch (action.type) {
+		case Action::VALIDATE:
+			transport->validate(action.address, action.deviceType, action.attempt);
+			break;
+		case Action::SUBSCRIBE:
+			transport->subscribe(action.address, action.deviceType, action.attempt);
+			break;
+		case Action::DISCONNECT:
+			transport->disconnect(action.address, action.attempt);
+			break;
+		case Action::SAVE_CACHE:
+		{
+			std::vector<KnownController> known;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (auto &connection : connections) {
+					if (connection.isCached) {
+						KnownController controller = { connection.address, connection.deviceType };
+						known.push_back(controller);
+					}
+				}
+			}
+
+			if (!saveConnectionCache(config.cachePath.c_str(), known)) {
+				printf("Failed to write the controller cache\n");
+			}
+			break;
+		}
+		}
+	}
+}
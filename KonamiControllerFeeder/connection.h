@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "decoder.h"
+
+#define CONNECTION_DEFAULT_BACKOFF_MIN_MS 250
+#define CONNECTION_DEFAULT_BACKOFF_MAX_MS 30000
+#define CONNECTION_DEFAULT_TIMEOUT_MS 10000
+#define CONNECTION_DEFAULT_DIRECT_ATTEMPTS 8
+
+// Scanning: waiting for an advertisement before trying again
+// Validating: opening the device and discovering the service and characteristic
+// Subscribing: notifications enabled, waiting for the first report
+// Streaming: reports are arriving
+// Lost: the link dropped or an attempt failed, resources are released before backing off
+// Backoff: waiting to connect directly again without an advertisement
+enum ConnectionState {
+	CONNECTION_SCANNING,
+	CONNECTION_VALIDATING,
+	CONNECTION_SUBSCRIBING,
+	CONNECTION_STREAMING,
+	CONNECTION_LOST,
+	CONNECTION_BACKOFF
+};
+
+// Everything the connection manager needs from the Bluetooth stack. Calls may complete
+// asynchronously, results are reported back through the ConnectionManager callbacks along with
+// the attempt number so results from an abandoned attempt can be told apart.
+class ConnectionTransport {
+public:
+	virtual ~ConnectionTransport() {}
+
+	// Open the device and discover the service and characteristic, then call onValidated
+	virtual void validate(uint64_t address, DeviceType deviceType, uint32_t attempt) = 0;
+	// Enable notifications on the characteristic found by validate, then call onSubscribed
+	virtual void subscribe(uint64_t address, DeviceType deviceType, uint32_t attempt) = 0;
+	// Drop everything held for the address if attempt is the one that validated it, no more callbacks
+	// should follow for it. A disconnect for an older attempt may only run once a newer attempt already
+	// holds the device again, and has to leave that one alone.
+	virtual void disconnect(uint64_t address, uint32_t attempt) = 0;
+
+	// Anything the transport keeps from validate has to be stored under the same lock disconnect takes,
+	// after checking ConnectionManager::isCurrentAttempt. Otherwise a validation that completes after its
+	// attempt timed out would leave a device behind that nothing ever disconnects.
+};
+
+struct ConnectionConfig {
+	uint64_t backoffMinNs;
+	uint64_t backoffMaxNs;
+	uint64_t timeoutNs;
+	int directAttempts; // Failed direct attempts in a row before waiting for an advertisement again
+	std::wstring cachePath; // Empty disables the cache
+};
+
+struct KnownController {
+	uint64_t address;
+	DeviceType deviceType;
+};
+
+struct ConnectionInfo {
+	uint64_t address;
+	DeviceType deviceType;
+	ConnectionState state;
+	uint32_t attempts;
+	uint32_t reconnects;
+	uint64_t timeToFirstReportNs; // Of the most recent successful attempt
+};
+
+const char *getConnectionStateName(ConnectionState state);
+void getDefaultConnectionConfig(ConnectionConfig &config);
+
+bool loadConnectionCache(const wchar_t *path, std::vector<KnownController> &controllers);
+bool saveConnectionCache(const wchar_t *path, const std::vector<KnownController> &controllers);
+
+// Drives every controller through scan -> validate -> subscribe -> streaming -> lost -> reconnect.
+// All callbacks are thread safe, transport calls are always made without holding the lock so a
+// transport may call back from inside validate or subscribe.
+class ConnectionManager {
+public:
+	ConnectionManager(ConnectionTransport *transport, const ConnectionConfig &config);
+
+	// Connects directly to every controller in the cache without waiting for an advertisement
+	void start(uint64_t now);
+
+	void onAdvertisement(uint64_t address, DeviceType deviceType, uint64_t now);
+	void onValidated(uint64_t address, uint32_t attempt, bool isSuccess, uint64_t now);
+	void onSubscribed(uint64_t address, uint32_t attempt, bool isSuccess, uint64_t now);
+	// Only needs to be called for the first report after subscribing
+	void onFirstReport(uint64_t address, uint32_t attempt, uint64_t now);
+	// attempt is the one that validated the link, so a late notice from an older device is ignored
+	void onLinkLost(uint64_t address, uint32_t attempt, uint64_t now);
+
+	// True while attempt is the one being validated. A transport can still keep what it found if this
+	// was true, any later failure of the attempt is followed by disconnect.
+	bool isCurrentAttempt(uint64_t address, uint32_t attempt);
+
+	// Handles timeouts and backoff, call this regularly
+	void update(uint64_t now);
+
+	bool getConnectionInfo(uint64_t address, ConnectionInfo &info);
+	size_t getConnectionCount();
+
+private:
+	struct Connection {
+		uint64_t address;
+		DeviceType deviceType;
+		ConnectionState state;
+		uint32_t attempt;
+		uint32_t failures;
+		uint32_t reconnects;
+		uint64_t attemptTime;
+		uint64_t stateTime;
+		uint64_t retryTime;
+		uint64_t timeToFirstReportNs;
+		bool isCached;
+	};
+
+	struct Action {
+		enum { VALIDATE, SUBSCRIBE, DISCONNECT, SAVE_CACHE } type;
+		uint64_t address;
+		DeviceType deviceType;
+		uint32_t attempt;
+	};
+
+	Connection *findConnection(uint64_t address);
+	void setState(Connection &connection, ConnectionState state, uint64_t now);
+	void beginAttempt(Connection &connection, uint64_t now, std::vector<Action> &actions);
+	void failAttempt(Connection &connection, const char *reason, uint64_t now, std::vector<Action> &actions);
+	uint64_t getBackoff(uint32_t failures) const;
+	void runActions(const std::vector<Action> &actions);
+
+	ConnectionTransport *transport;
+	ConnectionConfig config;
+
+	std::mutex mutex;
+	std::vector<Connection> connections;
+};
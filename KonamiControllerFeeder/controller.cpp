@@ -0,0 +1,222 @@
+#include <cstdio>
+#include <cwchar>
+#include <cwctype>
+#include <string>
+
+#include "controller.h"
+#include "logger.h"
+#include "timing.h"
+
+ControllerRegistry::ControllerRegistry() : controllerCount(0) {
+}
+
+bool ControllerRegistry::isVjoyDeviceInUse(unsigned int vjoyDevId) const {
+	auto count = controllerCount.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < count; i++) {
+		if (controllers[i]->vjoyDevId == vjoyDevId) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+Controller *ControllerRegistry::addController(uint64_t address, DeviceType deviceType, const DecoderConfig &config, const std::vector<DeviceMapping> &mappings, unsigned int defaultVjoyDevId) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto count = controllerCount.load(std::memory_order_relaxed);
+	if (count >= MAX_CONTROLLERS) {
+		return nullptr;
+	}
+
+	// An address mapping always wins over a device type mapping
+	unsigned int vjoyDevId = 0;
+	for (auto &mapping : mappings) {
+		if (mapping.isAddress && mapping.address == address) {
+			vjoyDevId = mapping.vjoyDevId;
+			break;
+		}
+		else if (!mapping.isAddress && mapping.deviceType == deviceType && vjoyDevId == 0) {
+			vjoyDevId = mapping.vjoyDevId;
+		}
+	}
+
+	if (vjoyDevId != 0 && isVjoyDeviceInUse(vjoyDevId)) {
+		printf("vJoy device %u is already used by another controller\n", vjoyDevId);
+		vjoyDevId = 0;
+	}
+
+	if (vjoyDevId == 0) {
+		for (auto id = defaultVjoyDevId; id <= MAX_VJOY_DEVICES; id++) {
+			if (!isVjoyDeviceInUse(id)) {
+				vjoyDevId = id;
+				break;
+			}
+		}
+	}
+
+	if (vjoyDevId == 0) {
+		return nullptr;
+	}
+
+	std::unique_ptr<Controller> controller(new Controller());
+	initController(*controller, count, address, deviceType, vjoyDevId, config);
+
+	auto ret = controller.get();
+	controllers[count] = std::move(controller);
+	controllerCount.store(count + 1, std::memory_order_release);
+
+	return ret;
+}
+
+Controller *ControllerRegistry::findController(uint64_t address) {
+	auto count = controllerCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; i++) {
+		if (controllers[i]->address == address) {
+			return controllers[i].get();
+		}
+	}
+
+	return nullptr;
+}
+
+Controller *ControllerRegistry::getController(size_t idx) {
+	if (idx >= controllerCount.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+
+	return controllers[idx].get();
+}
+
+size_t ControllerRegistry::getControllerCount() const {
+	return controllerCount.load(std::memory_order_acquire);
+}
+
+bool parseBluetoothAddress(const wchar_t *str, uint64_t &address) {
+	// aa:bb:cc:dd:ee:ff
+	if (wcslen(str) != 17) {
+		return false;
+	}
+
+	address = 0;
+	for (auto i = 0; i < 6; i++) {
+		if (i > 0 && str[i * 3 - 1] != L':') {
+			return false;
+		}
+
+		if (!iswxdigit(str[i * 3]) || !iswxdigit(str[i * 3 + 1])) {
+			return false;
+		}
+
+		wchar_t part[3] = { str[i * 3], str[i * 3 + 1], 0 };
+		address = (address << 8) | wcstoul(part, nullptr, 16);
+	}
+
+	return true;
+}
+
+static bool parseDeviceTypeKey(const std::wstring &str, DeviceType &deviceType) {
+	std::wstring key;
+	for (auto c : str) {
+		key += (wchar_t)towlower(c);
+	}
+
+	if (key == L"iidx") {
+		deviceType = DeviceType::IIDX;
+	}
+	else if (key == L"sdvx") {
+		deviceType = DeviceType::SDVX;
+	}
+	else if (key == L"popn") {
+		deviceType = DeviceType::POPN;
+	}
+	else if (key == L"gitadora") {
+		deviceType = DeviceType::GITADORA_GUITAR;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+bool parseDeviceMapping(const wchar_t *str, DeviceMapping &mapping) {
+	// Either "iidx=2" or "aa:bb:cc:dd:ee:ff=2"
+	auto separator = wcschr(str, L'=');
+	if (separator == nullptr) {
+		return false;
+	}
+
+	std::wstring key(str, separator - str);
+	auto vjoyDevId = wcstol(separator + 1, nullptr, 10);
+	if (vjoyDevId < 1 || vjoyDevId > MAX_VJOY_DEVICES) {
+		return false;
+	}
+
+	mapping.vjoyDevId = (unsigned int)vjoyDevId;
+	mapping.address = 0;
+	mapping.deviceType = DeviceType::UNKNOWN;
+	mapping.isAddress = parseBluetoothAddress(key.c_str(), mapping.address);
+
+	return mapping.isAddress || parseDeviceTypeKey(key, mapping.deviceType);
+}
+
+void initController(Controller &controller, size_t idx, uint64_t address, DeviceType deviceType, unsigned int vjoyDevId, const DecoderConfig &config) {
+	controller.idx = idx;
+	controller.address = address;
+	controller.deviceType = deviceType;
+	controller.vjoyDevId = vjoyDevId;
+	controller.decoder = getPacketDecoder(deviceType, config);
+	controller.remapTable = config.remapProfile != nullptr ? getRemapTable(*config.remapProfile, deviceType) : nullptr;
+	controller.queue = nullptr;
+	controller.isResetPending.store(false, std::memory_order_relaxed);
+	resetDecoderState(controller.decoderState);
+	resetClockSync(controller.clockSync);
+	resetMetrics(controller.metrics);
+}
+
+void setControllerOutput(Controller &controller, std::unique_ptr<OutputSink> deviceSink, bool isSuppressingDuplicates, bool isCollapsingBursts) {
+	controller.outputSink.reset(new CoalescingSink(deviceSink.get(), isSuppressingDuplicates, isCollapsingBursts));
+	controller.deviceSink = std::move(deviceSink);
+}
+
+void requestControllerReset(Controller &controller) {
+	controller.isResetPending.store(true, std::memory_order_release);
+}
+
+void processNotification(Controller &controller, const DecoderConfig &config, const unsigned char *data, size_t dataLen, uint64_t arrival, uint64_t latencyStart) {
+	auto &decoder = controller.decoder;
+	auto outputSink = controller.outputSink.get();
+
+	if (controller.isResetPending.load(std::memory_order_relaxed) && controller.isResetPending.exchange(false, std::memory_order_acquire)) {
+		resetDecoderState(controller.decoderState);
+		resetClockSync(controller.clockSync);
+		resetFrameTracking(controller.metrics);
+	}
+
+	recordNotification(controller.metrics, arrival, dataLen / decoder.packetLen);
+	outputSink->beginBurst();
+
+	for (size_t idx = 0; idx + decoder.packetLen <= dataLen; idx += decoder.packetLen) {
+		// Every packet of a notification arrives at the same time, the frame counter tells when it was actually sampled
+		auto timestamp = updateClockSync(controller.clockSync, data[idx + decoder.frameOffset], arrival);
+		logPacket(controller.vjoyDevId, timestamp, data + idx, decoder.packetLen);
+
+		FeederReport report;
+		decoder.decodePacket(data + idx, timestamp, config, controller.decoderState, report);
+
+		if (controller.remapTable != nullptr) {
+			applyRemap(*controller.remapTable, controller.decoderState, report);
+		}
+
+		outputSink->submit(report);
+
+		recordFrame(controller.metrics, report.frame);
+	}
+
+	outputSink->endBurst();
+
+	// A collapsed burst only reaches the device in endBurst, so that's where the notification is done
+	recordLatency(controller.metrics, getTimestampNs() - latencyStart);
+	recordFramePeriod(controller.metrics, getClockSyncPeriod(controller.clockSync));
+}
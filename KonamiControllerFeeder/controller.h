@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "clocksync.h"
+#include "decoder.h"
+#include "metrics.h"
+#include "output.h"
+#include "pipeline.h"
+#include "remap.h"
+
+#define MAX_CONTROLLERS 16
+#define MAX_VJOY_DEVICES 16
+
+// Maps a controller, either by its Bluetooth address or by its device type, to a vJoy device ID
+struct DeviceMapping {
+	bool isAddress;
+	uint64_t address;
+	DeviceType deviceType;
+	unsigned int vjoyDevId;
+};
+
+// Everything needed to decode and output one controller, so controllers never share any mutable state
+struct Controller {
+	size_t idx;
+	uint64_t address;
+	DeviceType deviceType;
+	unsigned int vjoyDevId;
+	PacketDecoder decoder;
+	DecoderState decoderState;
+	ClockSync clockSync;
+	const RemapTable *remapTable; // nullptr without a remap profile
+	ControllerMetrics metrics;
+	std::unique_ptr<OutputSink> deviceSink;
+	std::unique_ptr<CoalescingSink> outputSink;
+	NotificationQueue *queue; // Only used when notifications are handed to the feeder thread
+	std::atomic<bool> isResetPending; // Set by requestControllerReset, cleared by whoever processes the next notification
+};
+
+// Controllers are only ever added, so pointers handed out stay valid for the lifetime of the process
+class ControllerRegistry {
+public:
+	ControllerRegistry();
+
+	// Picks the vJoy device ID from the mappings, falling back to the first unused ID from defaultVjoyDevId.
+	// Returns nullptr if there's no room for another controller.
+	Controller *addController(uint64_t address, DeviceType deviceType, const DecoderConfig &config, const std::vector<DeviceMapping> &mappings, unsigned int defaultVjoyDevId);
+
+	Controller *findController(uint64_t address);
+	Controller *getController(size_t idx);
+	size_t getControllerCount() const;
+
+private:
+	bool isVjoyDeviceInUse(unsigned int vjoyDevId) const;
+
+	std::mutex mutex;
+	std::unique_ptr<Controller> controllers[MAX_CONTROLLERS];
+	std::atomic<size_t> controllerCount;
+};
+
+bool parseBluetoothAddress(const wchar_t *str, uint64_t &address);
+bool parseDeviceMapping(const wchar_t *str, DeviceMapping &mapping);
+
+// Everything but the output stage, for a controller that hasn't processed anything yet
+void initController(Controller &controller, size_t idx, uint64_t address, DeviceType deviceType, unsigned int vjoyDevId, const DecoderConfig &config);
+
+// Attach the output stage, the device sink is usually a vJoy device or a counting stub
+void setControllerOutput(Controller &controller, std::unique_ptr<OutputSink> deviceSink, bool isSuppressingDuplicates, bool isCollapsingBursts);
+
+// For a controller that connects again. The frame counter, knob positions and clock of the old connection
+// mean nothing for the new one, so they're reset right before its next notification is processed, on
+// the thread that processes it, instead of racing the feeder thread here.
+void requestControllerReset(Controller &controller);
+
+// arrival is when the notification was received and drives the packet timestamps, latency is measured
+// from latencyStart. Both are the same except for replays, where arrival comes from the capture.
+void processNotification(Controller &controller, const DecoderConfig &config, const unsigned char *data, size_t dataLen, uint64_t arrival, uint64_t latencyStart);
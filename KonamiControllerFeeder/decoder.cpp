@@ -0,0 +1,209 @@
+#include "decoder.h"
+
+/*
+IIDX:
+Notification packet (5 bytes):
+aa xx bb cc zz
+
+aa = unsigned byte, turntable value
+Spinning the turntable counter-clockwise increases the value, clockwise decreases the value
+
+xx = Always 0?
+
+bb =
+0x01 Button 1
+0x02 Button 2
+0x04 Button 3
+0x08 Button 4
+0x10 Button 5
+0x20 Button 6
+0x40 Button 7
+
+cc =
+0x01 E1
+0x02 E2
+
+zz = frame count, unsigned byte
+
+---
+
+SDVX:
+Notification packet (5 bytes):
+ll rr bb cc zz
+
+ll = unsigned byte, VOL-L knob
+Clockwise increases value, counter-clockwise decreases value
+
+rr = unsigned byte, VOL-R knob
+Clockwise increases value, counter-clockwise decreases value
+
+bb =
+0x01 BT-A
+0x02 BT-B
+0x04 BT-C
+0x08 BT-D
+0x10 FX-L
+0x20 FX-R
+
+cc =
+0x01 Start
+
+zz = frame count, unsigned byte
+
+---
+
+pop'n music:
+Notification packet (6 bytes):
+aa bb cc dd ee zz
+
+aa =
+0x01 Button 1
+0x02 Button 2
+0x04 Button 3
+0x08 Button 4
+0x10 Button 5
+0x20 Button 6
+0x40 Button 7
+0x80 Button 8
+
+bb =
+0x01 Button 9
+0x20 Start
+0x04 Select
+
+cc = X Axis?
+dd = Y Axis?
+ee = Z Axis?
+
+zz = frame count, unsigned byte
+
+---
+
+GITADORA (Guitar):
+Notification packet (6? bytes):
+aa bb cc dd ee zz?
+
+aa =
+0x01 Button 1?
+0x02 Button 2?
+0x04 Button 3?
+0x08 Button 4?
+0x10 Button 5?
+0x20 Start?
+0x40 Select?
+
+bb = 00?
+
+cc = X Axis?
+dd = Y Axis?
+ee = Z Axis?
+
+zz = frame count, unsigned byte
+*/
+
+const char *getDeviceTypeName(DeviceType deviceType) {
+	switch (deviceType) {
+	case DeviceType::IIDX:
+		return "IIDX";
+	case DeviceType::SDVX:
+		return "SDVX";
+	case DeviceType::POPN:
+		return "POPN";
+	case DeviceType::GITADORA_GUITAR:
+		return "GITADORA_GUITAR";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+void buildDecoderTables(DecoderConfig &config) {
+	for (auto axisIdx = 0; axisIdx <= AXIS_Y - AXIS_X; axisIdx++) {
+		buildAxisTable(config.axisTable[AXIS_X + axisIdx], config.axisConfig[AXIS_X + axisIdx]);
+	}
+}
+
+void resetDecoderState(DecoderState &state) {
+	for (auto axisIdx = 0; axisIdx <= AXIS_Y - AXIS_X; axisIdx++) {
+		state.currentValue[AXIS_X + axisIdx] = 0;
+		resetAxisMotion(state.motion[AXIS_X + axisIdx]);
+	}
+}
+
+static void updateDigitalAxes(const unsigned char *packet, uint64_t timestamp, const DecoderConfig &config, DecoderState &state) {
+	// Each axis is tracked on its own so one knob moving never delays the other
+	for (auto axisIdx = 0; axisIdx <= AXIS_Y - AXIS_X; axisIdx++) {
+		state.currentValue[AXIS_X + axisIdx] = updateAxisMotion(state.motion[AXIS_X + axisIdx], config.motionConfig, packet[axisIdx], packet[4], timestamp); // Turntable, or VOL-L/VOL-R
+	}
+}
+
+static void updateAnalogAxes(const unsigned char *packet, uint64_t timestamp, const DecoderConfig &config, DecoderState &state) {
+	state.currentValue[AXIS_X] = config.axisTable[AXIS_X].values[packet[0]]; // Turntable, or VOL-L
+	state.currentValue[AXIS_Y] = config.axisTable[AXIS_Y].values[packet[1]]; // VOL-R
+
+	if (config.isMotionTracked) {
+		for (auto axisIdx = 0; axisIdx <= AXIS_Y - AXIS_X; axisIdx++) {
+			updateAxisMotion(state.motion[AXIS_X + axisIdx], config.motionConfig, packet[axisIdx], packet[4], timestamp);
+		}
+	}
+}
+
+// IIDX and SDVX have the same format
+template <DeviceType Type, bool Digital>
+static void decodeKnobPacket(const unsigned char *packet, uint64_t timestamp, const DecoderConfig &config, DecoderState &state, FeederReport &report) {
+	if (Digital) {
+		updateDigitalAxes(packet, timestamp, config, state);
+	}
+	else {
+		updateAnalogAxes(packet, timestamp, config, state);
+	}
+
+	report.axisX = state.currentValue[AXIS_X];
+	report.axisY = state.currentValue[AXIS_Y];
+	report.axisZ = 0;
+	report.buttons = packet[2] | (packet[3] << 8);
+	report.frame = packet[4];
+	report.timestamp = timestamp;
+}
+
+// pop'n music and GITADORA have the same format
+template <DeviceType Type>
+static void decodeButtonPacket(const unsigned char *packet, uint64_t timestamp, const DecoderConfig &, DecoderState &, FeederReport &report) {
+	// TODO: Not sure how to scale these values for Gitadora yet. Unused in pop'n but they exist
+	report.axisX = packet[2];
+	report.axisY = packet[3];
+	report.axisZ = packet[4];
+	report.buttons = packet[0] | (packet[1] << 8);
+	report.frame = packet[5];
+	report.timestamp = timestamp;
+}
+
+PacketDecoder getPacketDecoder(DeviceType deviceType, const DecoderConfig &config) {
+	PacketDecoder decoder = {};
+
+	switch (deviceType) {
+	case DeviceType::POPN:
+		// pop'n music is a stream of packets with a size of 6 byte per packet
+		decoder.packetLen = 6;
+		decoder.frameOffset = 5;
+		decoder.decodePacket = decodeButtonPacket<DeviceType::POPN>;
+		break;
+	case DeviceType::GITADORA_GUITAR:
+		decoder.packetLen = 6;
+		decoder.frameOffset = 5;
+		decoder.decodePacket = decodeButtonPacket<DeviceType::GITADORA_GUITAR>;
+		break;
+	case DeviceType::SDVX:
+		decoder.packetLen = 5;
+		decoder.frameOffset = 4;
+		decoder.decodePacket = config.isDigital ? decodeKnobPacket<DeviceType::SDVX, true> : decodeKnobPacket<DeviceType::SDVX, false>;
+		break;
+	case DeviceType::IIDX:
+	default:
+		decoder.packetLen = 5;
+		decoder.frameOffset = 4;
+		decoder.decodePacket = config.isDigital ? decodeKnobPacket<DeviceType::IIDX, true> : decodeKnobPacket<DeviceType::IIDX, false>;
+		break;
+	}
+
+	return decoder;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "axis.h"
+#include "motion.h"
+
+#define AXIS_X 0
+#define AXIS_Y (AXIS_X + 1)
+
+enum DeviceType {
+	UNKNOWN,
+	IIDX,
+	SDVX,
+	POPN,
+	GITADORA_GUITAR,
+};
+
+// Platform independent version of the report that gets sent to the output device
+struct FeederReport {
+	int32_t axisX;
+	int32_t axisY;
+	int32_t axisZ;
+	uint32_t buttons;
+	uint8_t frame;
+	uint64_t timestamp; // Host monotonic clock, nanoseconds
+};
+
+struct RemapProfile;
+
+struct DecoderConfig {
+	bool isDigital;
+	AxisConfig axisConfig[2];
+	AxisTable axisTable[2]; // Built from axisConfig by buildDecoderTables
+	MotionConfig motionConfig;
+	const RemapProfile *remapProfile; // nullptr to output the controller as is
+	bool isMotionTracked; // Track the knob direction in analog mode too, for remap profiles that use it
+};
+
+// Turntable/knob tracking state, one per connected controller
+struct DecoderState {
+	int currentValue[2];
+	AxisMotion motion[2];
+};
+
+typedef void (*DecodePacketFunc)(const unsigned char *packet, uint64_t timestamp, const DecoderConfig &config, DecoderState &state, FeederReport &report);
+
+struct PacketDecoder {
+	size_t packetLen;
+	size_t frameOffset; // Position of the frame counter in a packet
+	DecodePacketFunc decodePacket;
+};
+
+const char *getDeviceTypeName(DeviceType deviceType);
+
+void buildDecoderTables(DecoderConfig &config);
+
+void resetDecoderState(DecoderState &state);
+
+// Pick the packet decoder for a device once at connect time so the notification handler doesn't have to branch on the device type
+PacketDecoder getPacketDecoder(DeviceType deviceType, const DecoderConfig &config);
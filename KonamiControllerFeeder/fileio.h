@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#ifndef _WIN32
+// Fails for paths that can't be represented in the current locale
+inline bool narrowPath(const wchar_t *path, std::string &ret) {
+	auto len = wcstombs(nullptr, path, 0);
+	if (len == (size_t)-1) {
+		return false;
+	}
+
+	ret.assign(len, '\0');
+	wcstombs(&ret[0], path, len);
+	return true;
+}
+#endif
+
+// Paths come from the command line as wide strings on Windows
+inline FILE *openFile(const wchar_t *path, const wchar_t *mode) {
+#ifdef _WIN32
+	FILE *file = nullptr;
+	if (_wfopen_s(&file, path, mode) != 0) {
+		return nullptr;
+	}
+	return file;
+#else
+	std::string narrowedPath;
+	std::string narrowedMode;
+	if (!narrowPath(path, narrowedPath) || !narrowPath(mode, narrowedMode)) {
+		return nullptr;
+	}
+	return fopen(narrowedPath.c_str(), narrowedMode.c_str());
+#endif
+}
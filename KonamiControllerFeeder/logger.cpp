@@ -0,0 +1,234 @@
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <thread>
+
+#include "logger.h"
+#include "timing.h"
+
+#define LOG_RING_SIZE 4096 // Must be a power of 2
+#define LOG_IDLE_SLEEP_MS 1
+
+enum LogRecordType {
+	LOG_RECORD_PACKET,
+	LOG_RECORD_EVENT,
+};
+
+struct LogRecord {
+	uint64_t timestamp;
+	const char *format;
+	int32_t value; // Device ID for packets
+	uint8_t type;
+	uint8_t len;
+	uint8_t data[LOG_MAX_PACKET_LEN];
+};
+
+// Bounded multi-producer/single-consumer ring, each slot carries a sequence number that tells
+// producers and the consumer whose turn it is to use the slot
+struct LogSlot {
+	std::atomic<size_t> sequence;
+	LogRecord record;
+};
+
+static LogSlot logRing[LOG_RING_SIZE];
+static std::atomic<size_t> logWriteIdx(0);
+static size_t logReadIdx = 0;
+static std::atomic<uint32_t> logDropped(0);
+
+static LogLevel logLevel = LOG_RAW;
+static bool logSynchronous = false;
+static std::atomic<bool> logRunning(false);
+static std::thread logThread;
+
+static void formatRecord(const LogRecord &record) {
+	if (record.type == LOG_RECORD_PACKET) {
+		printf("[%d] %llu.%06llu ", record.value, (unsigned long long)(record.timestamp / 1000000000), (unsigned long long)(record.timestamp / 1000 % 1000000));
+		for (auto i = 0; i < record.len; i++) {
+			printf("%02x ", record.data[i]);
+		}
+		printf("\n");
+	}
+	else {
+		printf(record.format, record.value);
+	}
+}
+
+static bool pushRecord(const LogRecord &record) {
+	auto pos = logWriteIdx.load(std::memory_order_relaxed);
+
+	for (;;) {
+		auto &slot = logRing[pos & (LOG_RING_SIZE - 1)];
+		auto sequence = slot.sequence.load(std::memory_order_acquire);
+		auto diff = (intptr_t)sequence - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (logWriteIdx.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				slot.record = record;
+				slot.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0) {
+			// Ring is full, never make the input thread wait on the console
+			logDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else {
+			pos = logWriteIdx.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+static bool popRecord(LogRecord &record) {
+	auto &slot = logRing[logReadIdx & (LOG_RING_SIZE - 1)];
+	auto sequence = slot.sequence.load(std::memory_order_acquire);
+
+	if (sequence != logReadIdx + 1) {
+		return false;
+	}
+
+	record = slot.record;
+	slot.sequence.store(logReadIdx + LOG_RING_SIZE, std::memory_order_release);
+	logReadIdx++;
+
+	return true;
+}
+
+static void loggerThreadMain() {
+	LogRecord record;
+
+	for (;;) {
+		auto hasRecords = false;
+
+		while (popRecord(record)) {
+			formatRecord(record);
+			hasRecords = true;
+		}
+
+		auto dropped = logDropped.exchange(0, std::memory_order_relaxed);
+		if (dropped > 0) {
+			printf("Logger dropped %u records\n", dropped);
+		}
+
+		if (hasRecords) {
+			fflush(stdout);
+		}
+		else if (!logRunning.load(std::memory_order_acquire)) {
+			break;
+		}
+		else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_SLEEP_MS));
+		}
+	}
+}
+
+void startLogger(LogLevel level, bool isSynchronous) {
+	logLevel = level;
+	logSynchronous = isSynchronous;
+
+	// The logger can be started again after stopLogger, the ring is empty at that point
+	for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+		logRing[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	logWriteIdx.store(0, std::memory_order_relaxed);
+	logReadIdx = 0;
+
+	if (logLevel != LOG_OFF && !logSynchronous) {
+		logRunning.store(true, std::memory_order_release);
+		logThread = std::thread(loggerThreadMain);
+	}
+}
+
+void stopLogger() {
+	if (logThread.joinable()) {
+		logRunning.store(false, std::memory_order_release);
+		logThread.join();
+	}
+}
+
+LogLevel getLogLevel() {
+	return logLevel;
+}
+
+bool parseLogLevel(const wchar_t *str, LogLevel &level) {
+	if (wcscmp(str, L"off") == 0) {
+		level = LOG_OFF;
+	}
+	else if (wcscmp(str, L"events") == 0) {
+		level = LOG_EVENTS;
+	}
+	else if (wcscmp(str, L"raw") == 0) {
+		level = LOG_RAW;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+static void submitRecord(const LogRecord &record) {
+	if (logSynchronous) {
+		formatRecord(record);
+	}
+	else {
+		pushRecord(record);
+	}
+}
+
+void logPacket(int deviceId, uint64_t timestamp, const unsigned char *data, size_t len) {
+	if (logLevel < LOG_RAW) {
+		return;
+	}
+
+	LogRecord record;
+	record.timestamp = timestamp;
+	record.format = nullptr;
+	record.value = deviceId;
+	record.type = LOG_RECORD_PACKET;
+	record.len = (uint8_t)(len < LOG_MAX_PACKET_LEN ? len : LOG_MAX_PACKET_LEN);
+	memcpy(record.data, data, record.len);
+
+	submitRecord(record);
+}
+
+static void makeEventRecord(LogRecord &record, const char *format, va_list args) {
+	record.timestamp = getTimestampNs();
+	record.format = format;
+	record.value = va_arg(args, int);
+	record.type = LOG_RECORD_EVENT;
+	record.len = 0;
+}
+
+void logEvent(const char *format, ...) {
+	if (logLevel < LOG_EVENTS) {
+		return;
+	}
+
+	LogRecord record;
+	va_list args;
+	va_start(args, format);
+	makeEventRecord(record, format, args);
+	va_end(args);
+
+	submitRecord(record);
+}
+
+void logError(const char *format, ...) {
+	LogRecord record;
+	va_list args;
+	va_start(args, format);
+	makeEventRecord(record, format, args);
+	va_end(args);
+
+	// Without a logger thread (off, or not started yet) errors are rare enough to print right away
+	if (logSynchronous || !logRunning.load(std::memory_order_acquire)) {
+		formatRecord(record);
+	}
+	else {
+		pushRecord(record);
+	}
+}
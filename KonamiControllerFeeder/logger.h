@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum LogLevel {
+	LOG_OFF,
+	LOG_EVENTS,
+	LOG_RAW,
+};
+
+#define LOG_MAX_PACKET_LEN 32
+
+// Lets GCC and Clang check logEvent and logError formats like printf's
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_FORMAT_CHECK(formatIdx, argIdx) __attribute__((format(printf, formatIdx, argIdx)))
+#else
+#define LOG_FORMAT_CHECK(formatIdx, argIdx)
+#endif
+
+// In asynchronous mode the caller only copies a fixed-size record into a lock-free ring buffer
+// and a background thread does the formatting and console output
+void startLogger(LogLevel level, bool isSynchronous);
+void stopLogger();
+
+LogLevel getLogLevel();
+bool parseLogLevel(const wchar_t *str, LogLevel &level);
+
+// The timestamp is the reconstructed host time of the packet rather than the time it was logged
+void logPacket(int deviceId, uint64_t timestamp, const unsigned char *data, size_t len);
+
+// Only the format pointer is stored, so it must be a string literal with exactly one int (or unsigned) argument.
+// The argument list is variadic only so the compiler can check the format against it.
+void logEvent(const char *format, ...) LOG_FORMAT_CHECK(1, 2);
+
+// Same as logEvent, but printed at every log level, including off
+void logError(const char *format, ...) LOG_FORMAT_CHECK(1, 2);
@@ -1,305 +1,543 @@
 // Based on https://github.com/urish/win-ble-cpp by Uri Shaked
 
+#include <cerrno>
+#include <cwctype>
 #include <iostream>
 #include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <pplawait.h>
 #include <sstream> 
 #include <string>
 #include <Windows.Devices.Bluetooth.h>
 #include <Windows.Devices.Bluetooth.Advertisement.h>
+#include <robuffer.h>
 #include <wrl/event.h>
 
 #include <vjoyinterface.h>
 
-#define AXIS_X 0
-#define AXIS_Y (AXIS_X + 1)
-
-#define UPDATE_FRAME_DELTA 1
+#include "advertfilter.h"
+#include "benchmark.h"
+#include "capture.h"
+#include "connection.h"
+#include "controller.h"
+#include "decoder.h"
+#include "logger.h"
+#include "metrics.h"
+#include "output.h"
+#include "pipeline.h"
+#include "remap.h"
+#include "sharedmemsink.h"
+#include "timing.h"
+#include "udpreceiver.h"
+#include "udpsink.h"
+#include "vjoysink.h"
 
 using namespace Platform;
 using namespace Windows::Devices;
 using namespace Windows::Storage;
 
-enum DeviceType {
-	UNKNOWN,
-	IIDX,
-	SDVX,
-	POPN,
-	GITADORA_GUITAR,
-};
-
-String^ targetDeviceIidx = L"IIDX Entry model";
-String^ targetDeviceSdvx = L"SDVX Entry Model";
-String^ targetDevicePopn = L"Pop'n controller";
-String^ targetDeviceGitadoraGuitar = L"GITADORA controller"; // TODO: Temporary until real name is known
-
 auto serviceUUID = Bluetooth::BluetoothUuidHelper::FromShortId(0xff00);
 auto characteristicUUID = Bluetooth::BluetoothUuidHelper::FromShortId(0xff01);
-auto vjoyDevId = 1; // Default to device ID 1, but let the user specify a different device ID later
-
-std::wstring formatBluetoothAddress(unsigned long long bluetoothAddress) {
-	std::wostringstream ret;
-	ret << std::hex << std::setfill(L'0')
-		<< std::setw(2) << ((bluetoothAddress >> (5 * 8)) & 0xff) << ":"
-		<< std::setw(2) << ((bluetoothAddress >> (4 * 8)) & 0xff) << ":"
-		<< std::setw(2) << ((bluetoothAddress >> (3 * 8)) & 0xff) << ":"
-		<< std::setw(2) << ((bluetoothAddress >> (2 * 8)) & 0xff) << ":"
-		<< std::setw(2) << ((bluetoothAddress >> (1 * 8)) & 0xff) << ":"
-		<< std::setw(2) << ((bluetoothAddress >> (0 * 8)) & 0xff);
-	return ret.str();
+auto vjoyDevId = 1; // First device ID to hand out to controllers, additional controllers use the next free IDs
+
+// Access the notification bytes in place instead of copying them out through a DataReader
+const unsigned char *getBufferData(Streams::IBuffer^ buffer) {
+	Microsoft::WRL::ComPtr<Streams::IBufferByteAccess> bufferByteAccess;
+	if (FAILED(reinterpret_cast<IInspectable*>(buffer)->QueryInterface(IID_PPV_ARGS(&bufferByteAccess)))) {
+		return nullptr;
+	}
+
+	byte *data = nullptr;
+	bufferByteAccess->Buffer(&data);
+	return data;
 }
 
-int lastRawValue[2] = { 0 };
-int currentValue[2] = { 0 };
-int lastValue[2] = { 0 };
-bool initAxis[2] = { false };
-double axisSensitivity[2] = { 1.0, 1.0 };
-int lastUpdateFrame = -1;
+DecoderConfig decoderConfig = { false, { { 1.0, 1.0, 0 }, { 1.0, 1.0, 0 } }, {}, { MOTION_DEFAULT_HYSTERESIS, MOTION_DEFAULT_HOLD_FRAMES, 0 } };
+
+std::unique_ptr<RemapProfile> remapProfile;
+
+ControllerRegistry controllerRegistry;
+std::vector<DeviceMapping> deviceMappings;
+
+bool isVjoyEnabled = true;
+bool isSharedMemoryEnabled = false;
+bool isUdpEnabled = false;
+std::string udpTargetHost;
+uint16_t udpTargetPort = KCF_UDP_DEFAULT_PORT;
+
+// Held state produces no reports, so the main loop has to repeat it to every UDP target
+std::mutex udpSinksMutex;
+std::vector<UdpSink*> udpSinks;
+bool isSuppressingDuplicates = true;
+bool isCollapsingBursts = false;
+
+AdvertisementFilter advertisementFilter;
+bool isScanFilterEnabled = false;
+
+WaitStrategy waitStrategy = WAIT_BLOCK;
+std::unique_ptr<NotificationPipeline> pipeline;
+
+CaptureWriter captureWriter = {};
+
+String^ metricsReportPath = nullptr;
+
+struct ReplayContext {
+	Controller *controllers[256];
+	uint64_t packets;
+};
 
-bool isDigital = false;
+int acquireVjoyDevice(unsigned int deviceId) {
+	VjdStat status = GetVJDStatus(deviceId);
 
-concurrency::task<bool> isValidController(unsigned long long bluetoothAddress) {
-	auto leDevice = co_await Bluetooth::BluetoothLEDevice::FromBluetoothAddressAsync(bluetoothAddress);
-	auto servicesResult = co_await leDevice->GetGattServicesForUuidAsync(serviceUUID);
-	co_return servicesResult->Status == Windows::Devices::Bluetooth::GenericAttributeProfile::GattCommunicationStatus::Success;
+	switch (status) {
+	case VJD_STAT_OWN:
+		printf("vJoy device %d is already owned by this feeder\n", deviceId);
+		break;
+	case VJD_STAT_FREE:
+		printf("vJoy device %d is free\n", deviceId);
+		break;
+	case VJD_STAT_BUSY:
+		printf("vJoy device %d is already owned by another feeder\n", deviceId);
+		return -3;
+	case VJD_STAT_MISS:
+		printf("vJoy device %d is not installed or disabled\n", deviceId);
+		return -4;
+	default:
+		printf("vJoy device %d general error\n", deviceId);
+		return -1;
+	};
+
+	// Acquire the vJoy device
+	if (!AcquireVJD(deviceId)) {
+		printf("Failed to acquire vJoy device number %d.\n", deviceId);
+		return -1;
+	}
+	else {
+		printf("Acquired device number %d - OK\n", deviceId);
+	}
+
+	return 0;
 }
 
-concurrency::task<void> connectToController(unsigned long long bluetoothAddress, String^ deviceName) {
-	auto leDevice = co_await Bluetooth::BluetoothLEDevice::FromBluetoothAddressAsync(bluetoothAddress);
-	auto servicesResult = co_await leDevice->GetGattServicesForUuidAsync(serviceUUID);
+Controller *createController(unsigned long long bluetoothAddress, DeviceType deviceType) {
+	auto controller = controllerRegistry.addController(bluetoothAddress, deviceType, decoderConfig, deviceMappings, vjoyDevId);
+	if (controller == nullptr) {
+		printf("No vJoy device left for another controller\n");
+		return nullptr;
+	}
+
+	std::wcout << "Using vJoy device ID " << controller->vjoyDevId << " for " << getDeviceTypeName(deviceType) << " controller" << std::endl;
+
+	std::unique_ptr<FanoutSink> sinks(new FanoutSink());
 
-	auto service = servicesResult->Services->GetAt(0);
-	auto characteristicsResult = co_await service->GetCharacteristicsForUuidAsync(characteristicUUID);
-	auto characteristic = characteristicsResult->Characteristics->GetAt(0);
+	if (isVjoyEnabled) {
+		// The controller stays registered on failure so the vJoy device ID isn't handed out again
+		if (acquireVjoyDevice(controller->vjoyDevId) != 0) {
+			return nullptr;
+		}
 
-	auto status = co_await characteristic->WriteClientCharacteristicConfigurationDescriptorAsync(Bluetooth::GenericAttributeProfile::GattClientCharacteristicConfigurationDescriptorValue::Notify);
+		sinks->addSink(std::unique_ptr<OutputSink>(new VJoySink(controller->vjoyDevId)));
+	}
 
-	DeviceType deviceType = DeviceType::UNKNOWN;
+	if (isSharedMemoryEnabled) {
+		std::unique_ptr<SharedMemorySink> sharedMemorySink(new SharedMemorySink(controller->vjoyDevId, deviceType));
+		if (sharedMemorySink->isOpen()) {
+			printf("Publishing controller state to shared memory region %s%u\n", KCF_SHARED_STATE_NAME_PREFIX, controller->vjoyDevId);
+			sinks->addSink(std::move(sharedMemorySink));
+		}
+		else {
+			printf("Failed to create shared memory region for vJoy device ID %u\n", controller->vjoyDevId);
+		}
+	}
 
-	if (deviceName == targetDeviceIidx) {
-		deviceType = DeviceType::IIDX;
+	if (isUdpEnabled) {
+		std::unique_ptr<UdpSink> udpSink(new UdpSink(udpTargetHost.c_str(), udpTargetPort, controller->vjoyDevId, deviceType, UDP_DEFAULT_KEYFRAME_INTERVAL_MS));
+		if (udpSink->isOpen()) {
+			printf("Streaming controller state to %s port %u\n", udpTargetHost.c_str(), udpTargetPort);
+			{
+				std::lock_guard<std::mutex> lock(udpSinksMutex);
+				udpSinks.push_back(udpSink.get());
+			}
+			sinks->addSink(std::move(udpSink));
+		}
+		else {
+			printf("Failed to open UDP socket to %s port %u\n", udpTargetHost.c_str(), udpTargetPort);
+		}
 	}
-	else if (deviceName == targetDeviceSdvx) {
-		deviceType = DeviceType::SDVX;
+
+	if (!isVjoyEnabled && !isSharedMemoryEnabled && !isUdpEnabled) {
+		sinks->addSink(std::unique_ptr<OutputSink>(new CountingSink()));
 	}
-	else if (deviceName == targetDevicePopn) {
-		deviceType = DeviceType::POPN;
+
+	setControllerOutput(*controller, std::move(sinks), isSuppressingDuplicates, isCollapsingBursts);
+
+	if (pipeline) {
+		controller->queue = pipeline->addQueue(controller);
 	}
-	else if (deviceName == targetDeviceGitadoraGuitar) {
-		deviceType = DeviceType::GITADORA_GUITAR;
+
+	return controller;
+}
+
+bool replayNotification(void *context, const CaptureRecord &record) {
+	auto replay = (ReplayContext*)context;
+	auto &controller = replay->controllers[record.controllerIdx];
+
+	if (controller == nullptr) {
+		// Replayed controllers are keyed by their index in the capture instead of a Bluetooth address
+		controller = createController(record.controllerIdx, record.deviceType);
+		if (controller == nullptr) {
+			return false;
+		}
 	}
 
-	characteristic->ValueChanged += ref new Windows::Foundation::TypedEventHandler<Bluetooth::GenericAttributeProfile::GattCharacteristic^, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs^>(
-		[characteristic, deviceType](Bluetooth::GenericAttributeProfile::GattCharacteristic^ gattCharacteristic, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs^ eventArgs) {
-			auto reader = Streams::DataReader::FromBuffer(eventArgs->CharacteristicValue);
-			std::vector<unsigned char> data(reader->UnconsumedBufferLength);
+	// Packets are timestamped from the capture so --replay-fast decodes exactly like a realtime replay
+	processNotification(*controller, decoderConfig, record.data, record.len, record.timestamp, getTimestampNs());
+	replay->packets += record.len / controller->decoder.packetLen;
 
-			if (!data.empty()) {
-				reader->ReadBytes(Platform::ArrayReference<unsigned char>(&data[0], (unsigned int)data.size()));
+	return true;
+}
 
-				/*
-				IIDX:
-				Notification packet (5 bytes):
-				aa xx bb cc zz
+OutputSink *createUdpStream(void *context, unsigned int id, DeviceType deviceType) {
+	// Remote controllers are keyed by their stream ID instead of a Bluetooth address
+	auto controller = createController(id, deviceType);
+	return controller != nullptr ? controller->outputSink.get() : nullptr;
+}
 
-				aa = unsigned byte, turntable value
-				Spinning the turntable counter-clockwise increases the value, clockwise decreases the value
+void sendUdpIdleKeyframes() {
+	std::lock_guard<std::mutex> lock(udpSinksMutex);
+	for (auto udpSink : udpSinks) {
+		udpSink->sendIdleKeyframe();
+	}
+}
 
-				xx = Always 0?
+void printUdpMetrics(UdpReceiver &receiver) {
+	auto now = getTimestampNs();
+	for (unsigned int id = 0; id < UDP_MAX_STREAMS; id++) {
+		auto stats = receiver.getStreamStats(id);
+		if (stats == nullptr) {
+			continue;
+		}
 
-				bb =
-				0x01 Button 1
-				0x02 Button 2
-				0x04 Button 3
-				0x08 Button 4
-				0x10 Button 5
-				0x20 Button 6
-				0x40 Button 7
+		printMetricsSummary(*receiver.getStreamMetrics(id), id, now);
+		printf("[%u] %llu datagrams, %llu keyframes, %llu idle keyframes, %llu sender restarts, %llu lost, %llu late, %llu reports skipped waiting for a keyframe\n",
+			id,
+			(unsigned long long)stats->datagrams,
+			(unsigned long long)stats->keyframes,
+			(unsigned long long)stats->idleKeyframes,
+			(unsigned long long)stats->restarts,
+			(unsigned long long)stats->lostDatagrams,
+			(unsigned long long)stats->lateDatagrams,
+			(unsigned long long)stats->skippedReports);
+	}
+}
 
-				cc =
-				0x01 E1
-				0x02 E2
+// Runs on the feeder thread for every notification handed over by a controller's callback
+void feedNotification(void *context, const unsigned char *data, size_t len, uint64_t arrival) {
+	auto controller = (Controller*)context;
 
-				zz = frame count, unsigned byte
+	writeCaptureRecord(captureWriter, arrival, controller->deviceType, (uint8_t)controller->idx, data, len);
+	processNotification(*controller, decoderConfig, data, len, arrival, arrival);
+}
 
-				---
+void relinquishVjoyDevices() {
+	if (!isVjoyEnabled) {
+		return;
+	}
 
-				SDVX:
-				Notification packet (5 bytes):
-				ll rr bb cc zz
+	for (size_t i = 0; i < controllerRegistry.getControllerCount(); i++) {
+		auto controller = controllerRegistry.getController(i);
+		if (controller->deviceSink) {
+			RelinquishVJD(controller->vjoyDevId);
+		}
+	}
+}
 
-				ll = unsigned byte, VOL-L knob
-				Clockwise increases value, counter-clockwise decreases value
+void printMetrics() {
+	auto now = getTimestampNs();
+	for (size_t i = 0; i < controllerRegistry.getControllerCount(); i++) {
+		auto controller = controllerRegistry.getController(i);
+		printMetricsSummary(controller->metrics, controller->vjoyDevId, now);
+	}
+}
 
-				rr = unsigned byte, VOL-R knob
-				Clockwise increases value, counter-clockwise decreases value
+void writeMetrics() {
+	if (metricsReportPath == nullptr) {
+		return;
+	}
 
-				bb =
-				0x01 BT-A
-				0x02 BT-B
-				0x04 BT-C
-				0x08 BT-D
-				0x10 FX-L
-				0x20 FX-R
+	std::vector<MetricsReportEntry> entries;
+	for (size_t i = 0; i < controllerRegistry.getControllerCount(); i++) {
+		auto controller = controllerRegistry.getController(i);
+		MetricsReportEntry entry = { (int)controller->vjoyDevId, controller->deviceType, &controller->metrics };
+		entries.push_back(entry);
+	}
 
-				cc =
-				0x01 Start
+	if (!writeMetricsReport(entries.data(), entries.size(), metricsReportPath->Data())) {
+		std::wcout << "Failed to write metrics report: " << metricsReportPath->Data() << std::endl;
+	}
+}
 
-				zz = frame count, unsigned byte
+BOOL WINAPI consoleCtrlHandler(DWORD ctrlType) {
+	// The feeder is normally stopped with Ctrl+C so make sure everything recorded so far makes it to disk
+	flushCaptureWriter(captureWriter);
+	writeMetrics();
+	return FALSE;
+}
 
-				---
+// Reuses the controller from an earlier connection so a reconnected controller keeps its vJoy device
+Controller *getOrCreateController(unsigned long long bluetoothAddress, DeviceType deviceType) {
+	auto controller = controllerRegistry.findController(bluetoothAddress);
+	if (controller == nullptr) {
+		return createController(bluetoothAddress, deviceType);
+	}
 
-				pop'n music:
-				Notification packet (6 bytes):
-				aa bb cc dd ee zz
+	if (!controller->outputSink) {
+		return nullptr;
+	}
 
-				aa =
-				0x01 Button 1
-				0x02 Button 2
-				0x04 Button 3
-				0x08 Button 4
-				0x10 Button 5
-				0x20 Button 6
-				0x40 Button 7
-				0x80 Button 8
+	// The feeder thread may still be working on the last notifications of the old connection
+	requestControllerReset(*controller);
+	return controller;
+}
 
-				bb =
-				0x01 Button 9
-				0x20 Start
-				0x04 Select
+// Bluetooth side of the connection manager. The device and characteristic found during validation are
+// kept until the link is dropped, so subscribing never repeats service discovery.
+class BleTransport : public ConnectionTransport {
+public:
+	void validate(uint64_t address, DeviceType deviceType, uint32_t attempt) override {
+		validateController(address, attempt);
+	}
 
-				cc = X Axis?
-				dd = Y Axis?
-				ee = Z Axis?
+	void subscribe(uint64_t address, DeviceType deviceType, uint32_t attempt) override {
+		subscribeController(address, deviceType, attempt);
+	}
 
-				zz = frame count, unsigned byte
+	void disconnect(uint64_t address, uint32_t attempt) override;
 
-				---
+private:
+	struct Link {
+		uint32_t attempt; // The attempt that validated the device
+		Bluetooth::BluetoothLEDevice^ device;
+		Bluetooth::GenericAttributeProfile::GattCharacteristic^ characteristic;
+		Windows::Foundation::EventRegistrationToken statusToken;
+		Windows::Foundation::EventRegistrationToken valueToken;
+		bool isSubscribed;
+	};
 
-				GITADORA (Guitar):
-				Notification packet (6? bytes):
-				aa bb cc dd ee zz?
+	concurrency::task<void> validateController(uint64_t address, uint32_t attempt);
+	concurrency::task<void> subscribeController(uint64_t address, DeviceType deviceType, uint32_t attempt);
 
-				aa =
-				0x01 Button 1?
-				0x02 Button 2?
-				0x04 Button 3?
-				0x08 Button 4?
-				0x10 Button 5?
-				0x20 Start?
-				0x40 Select?
+	std::mutex mutex;
+	std::map<uint64_t, Link> links;
+};
 
-				bb = 00?
-
-				cc = X Axis?
-				dd = Y Axis?
-				ee = Z Axis?
-
-				zz = frame count, unsigned byte
-				*/
-
-				int packetLen = 5; // IIDX and SDVX
-				if (deviceType == DeviceType::POPN || deviceType == DeviceType::GITADORA_GUITAR) {
-					// pop'n music is a stream of packets with a size of 6 byte per packet
-					packetLen = 6;
+BleTransport bleTransport;
+std::unique_ptr<ConnectionManager> connectionManager;
+
+concurrency::task<void> BleTransport::validateController(uint64_t address, uint32_t attempt) {
+	Bluetooth::BluetoothLEDevice^ device = nullptr;
+	Bluetooth::GenericAttributeProfile::GattCharacteristic^ characteristic = nullptr;
+
+	// Connecting by address works for known controllers even when they haven't been seen by the watcher
+	try {
+		device = co_await Bluetooth::BluetoothLEDevice::FromBluetoothAddressAsync(address);
+		if (device != nullptr) {
+			auto servicesResult = co_await device->GetGattServicesForUuidAsync(serviceUUID);
+			if (servicesResult->Status == Bluetooth::GenericAttributeProfile::GattCommunicationStatus::Success && servicesResult->Services->Size > 0) {
+				auto characteristicsResult = co_await servicesResult->Services->GetAt(0)->GetCharacteristicsForUuidAsync(characteristicUUID);
+				if (characteristicsResult->Status == Bluetooth::GenericAttributeProfile::GattCommunicationStatus::Success && characteristicsResult->Characteristics->Size > 0) {
+					characteristic = characteristicsResult->Characteristics->GetAt(0);
 				}
+			}
+		}
+	}
+	catch (Exception^) {
+		characteristic = nullptr;
+	}
+
+	if (characteristic == nullptr) {
+		delete device;
+		connectionManager->onValidated(address, attempt, false, getTimestampNs());
+		co_return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
 
-				for (auto idx = 0; idx < data.size(); idx += packetLen) {
-					JOYSTICK_POSITION iReport = {};
-					iReport.bDevice = (BYTE)vjoyDevId;
-
-					for (int i = 0; i < packetLen; i++) {
-						printf("%02x ", data[idx + i]);
-					}
-					printf("\n");
-
-					if (deviceType == DeviceType::POPN || deviceType == DeviceType::GITADORA_GUITAR) {
-						// TODO: Not sure how to scale these values for Gitadora yet. Unused in pop'n but they exist
-						iReport.wAxisX = data[idx + 2];
-						iReport.wAxisY = data[idx + 3];
-						iReport.wAxisZ = data[idx + 4];
-						iReport.lButtons = data[idx] | (data[idx + 1] << 8);
-					}
-					else {
-						// IIDX and SDVX have the same format
-						if (isDigital) {
-							auto frameOverflow = abs(lastUpdateFrame - data[idx + 4]) > 200;
-							if (lastUpdateFrame == -1 || (data[idx + 4] - lastUpdateFrame > UPDATE_FRAME_DELTA) || (frameOverflow && (data[idx + 4] - lastUpdateFrame) < UPDATE_FRAME_DELTA)) {
-								for (auto axisIdx = 0; axisIdx <= AXIS_Y - AXIS_X; axisIdx++) {
-									if (!initAxis[AXIS_X + axisIdx]) {
-										lastRawValue[AXIS_X + axisIdx] = data[idx + axisIdx];
-										initAxis[AXIS_X + axisIdx] = true;
-									}
-
-									auto newValue = data[idx + axisIdx]; // Turntable, or VOL-L
-									auto underflow = abs(lastRawValue[AXIS_X + axisIdx] - newValue) > 200;
-									auto nextValue = 0;
-
-									if (underflow) {
-										if (lastRawValue[AXIS_X + axisIdx] - newValue < 0) {
-											nextValue = 0;
-										}
-										else if (lastRawValue[AXIS_X + axisIdx] - newValue > 0) {
-											nextValue = 32768;
-										}
-										else {
-											nextValue = 32768 / 2;
-										}
-									}
-									else {
-										if (lastRawValue[AXIS_X + axisIdx] - newValue > 0) {
-											nextValue = 0;
-										}
-										else if (lastRawValue[AXIS_X + axisIdx] - newValue < 0) {
-											nextValue = 32768;
-										}
-										else {
-											nextValue = 32768 / 2;
-										}
-									}
-
-									lastRawValue[AXIS_X + axisIdx] = newValue;
-									currentValue[AXIS_X + axisIdx] = nextValue;
-									lastUpdateFrame = data[idx + 4];
-								}
-							}
-						}
-						else {
-							currentValue[AXIS_X] = (LONG)std::round((((double)data[idx] * axisSensitivity[AXIS_X]) / 255.0) * 32768.0) % 32768; // Turntable, or VOL-L
-							currentValue[AXIS_Y] = (LONG)std::round((((double)data[idx + 1] * axisSensitivity[AXIS_Y]) / 255.0) * 32768.0) % 32768; // VOL-R
-						}
-
-						iReport.wAxisX = currentValue[AXIS_X];
-						iReport.wAxisY = currentValue[AXIS_Y];
-						iReport.lButtons = data[idx + 2] | (data[idx + 3] << 8);
-					}
-
-					// Send position data to vJoy device
-					if (!UpdateVJD(vjoyDevId, &iReport)) {
-						printf("Feeding vJoy device number %d failed - try to enable device\n", vjoyDevId);
-						AcquireVJD(vjoyDevId);
-					}
+		// The attempt may have timed out while discovering services. Its disconnect has already run and
+		// found nothing, so the device has to be closed here or it would keep the link up forever.
+		if (!connectionManager->isCurrentAttempt(address, attempt)) {
+			delete device;
+			co_return;
+		}
+
+		Link link = {};
+		link.attempt = attempt;
+		link.device = device;
+		link.characteristic = characteristic;
+		link.statusToken = device->ConnectionStatusChanged += ref new Windows::Foundation::TypedEventHandler<Bluetooth::BluetoothLEDevice^, Object^>(
+			[address, attempt](Bluetooth::BluetoothLEDevice^ sender, Object^ args) {
+				if (sender->ConnectionStatus == Bluetooth::BluetoothConnectionStatus::Disconnected) {
+					connectionManager->onLinkLost(address, attempt, getTimestampNs());
 				}
 			}
+		);
+		links[address] = link;
+	}
+
+	connectionManager->onValidated(address, attempt, true, getTimestampNs());
+}
+
+concurrency::task<void> BleTransport::subscribeController(uint64_t address, DeviceType deviceType, uint32_t attempt) {
+	Bluetooth::GenericAttributeProfile::GattCharacteristic^ characteristic = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto link = links.find(address);
+		if (link != links.end()) {
+			characteristic = link->second.characteristic;
+		}
+	}
+
+	auto controller = getOrCreateController(address, deviceType);
+	if (characteristic == nullptr || controller == nullptr || controller->queue == nullptr) {
+		connectionManager->onSubscribed(address, attempt, false, getTimestampNs());
+		co_return;
+	}
+
+	// Only the first report of each connection is passed on to the connection manager
+	auto isFirstReport = std::make_shared<std::atomic<bool>>(true);
+
+	// Every controller gets its own handler and state, so controllers never wait on each other
+	auto valueToken = characteristic->ValueChanged += ref new Windows::Foundation::TypedEventHandler<Bluetooth::GenericAttributeProfile::GattCharacteristic^, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs^>(
+		[controller, address, attempt, isFirstReport](Bluetooth::GenericAttributeProfile::GattCharacteristic^ gattCharacteristic, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs^ eventArgs) {
+			auto timestamp = getTimestampNs();
+			auto buffer = eventArgs->CharacteristicValue;
+			auto data = getBufferData(buffer);
+			auto dataLen = (size_t)buffer->Length;
+
+			if (data == nullptr) {
+				return;
+			}
+
+			// Decoding and output happen on the feeder thread, this only copies the notification
+			size_t depth;
+			if (pipeline->push(controller->queue, data, dataLen, timestamp, depth)) {
+				recordQueueDepth(controller->metrics, depth);
+			}
+			else {
+				recordQueueOverflow(controller->metrics);
+			}
+
+			if (isFirstReport->load(std::memory_order_relaxed) && isFirstReport->exchange(false)) {
+				connectionManager->onFirstReport(address, attempt, timestamp);
+			}
 		}
 	);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto link = links.find(address);
+		if (link != links.end() && link->second.characteristic == characteristic) {
+			link->second.valueToken = valueToken;
+			link->second.isSubscribed = true;
+		}
+		else {
+			characteristic->ValueChanged -= valueToken;
+		}
+	}
+
+	auto isSuccess = false;
+	try {
+		auto status = co_await characteristic->WriteClientCharacteristicConfigurationDescriptorAsync(Bluetooth::GenericAttributeProfile::GattClientCharacteristicConfigurationDescriptorValue::Notify);
+		isSuccess = status == Bluetooth::GenericAttributeProfile::GattCommunicationStatus::Success;
+	}
+	catch (Exception^) {
+		isSuccess = false;
+	}
+
+	connectionManager->onSubscribed(address, attempt, isSuccess, getTimestampNs());
+}
+
+void BleTransport::disconnect(uint64_t address, uint32_t attempt) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto link = links.find(address);
+	if (link == links.end() || link->second.attempt != attempt) {
+		return;
+	}
+
+	if (link->second.isSubscribed) {
+		link->second.characteristic->ValueChanged -= link->second.valueToken;
+	}
+	link->second.device->ConnectionStatusChanged -= link->second.statusToken;
+
+	// Closing the device is what actually lets Windows drop the link
+	delete link->second.device;
+	links.erase(link);
 }
 
 int main(Array<String^>^ args) {
 	Microsoft::WRL::Wrappers::RoInitializeWrapper initialize(RO_INIT_MULTITHREADED);
 
+	auto logLevel = LOG_RAW;
+	auto isLogSynchronous = false;
+	String^ recordPath = nullptr;
+	String^ replayPath = nullptr;
+	auto isReplayRealtime = true;
+	auto metricsInterval = 0;
+	String^ controllerCachePath = L"controllers.cache";
+	auto isBenchmark = false;
+	String^ benchmarkBaselinePath = nullptr;
+	String^ benchmarkSavePath = nullptr;
+	auto benchmarkThreshold = BENCHMARK_DEFAULT_THRESHOLD;
+	String^ remapProfilePath = nullptr;
+	auto udpListenPort = 0;
+
 	auto argIdx = 1;
 	while (argIdx < args->Length) {
 		auto arg = args[argIdx++];
 
 		if (arg == "--help") {
-			std::wcout << "usage: " << args[0]->Data() << " [--sensitivity-x 1.0] [--sensitivity-y 1.0] [--device-id 1] [--digital] [--help]" << std::endl;
+			std::wcout << "usage: " << args[0]->Data() << " [--sensitivity-x 1.0] [--sensitivity-y 1.0] [--curve-x 1.0] [--curve-y 1.0] [--deadzone-x 0] [--deadzone-y 0] [--device-id 1] [--device-map iidx=1] [--digital] [--digital-hysteresis 1] [--digital-hold-frames 2] [--digital-hold-us 0] [--log-level raw] [--log-sync] [--record file] [--replay file] [--replay-fast] [--metrics-interval 0] [--metrics-report file] [--coalesce-bursts] [--no-suppress] [--no-vjoy] [--shared-memory] [--controller-cache file] [--no-controller-cache] [--wait-strategy block] [--scan-filter] [--benchmark] [--benchmark-baseline file] [--benchmark-save file] [--benchmark-threshold 10] [--remap-profile file] [--udp-target host:port] [--udp-listen 34580] [--help]" << std::endl;
 			std::wcout << std::endl;
 			std::wcout << "arguments:" << std::endl;
-			std::wcout << "\t--device-id (val) - Set the target vJoy device ID" << std::endl;
+			std::wcout << "\t--device-id (val) - Set the first vJoy device ID, additional controllers use the next free IDs" << std::endl;
+			std::wcout << "\t--device-map (type|address)=(val) - Use a specific vJoy device ID for a device type (iidx, sdvx, popn, gitadora) or Bluetooth address. Can be used multiple times" << std::endl;
 			std::wcout << "\t--sensitivity-x (val) - Set the sensitivity of the X axis for analog mode" << std::endl;
 			std::wcout << "\t--sensitivity-y (val) - Set the sensitivity of the Y axis for analog mode" << std::endl;
+			std::wcout << "\t--curve-x (val) - Set the response curve exponent of the X axis for analog mode, 1.0 is linear and it has to be greater than 0" << std::endl;
+			std::wcout << "\t--curve-y (val) - Set the response curve exponent of the Y axis for analog mode, 1.0 is linear and it has to be greater than 0" << std::endl;
+			std::wcout << "\t--deadzone-x (val) - Treat raw X axis values (0-255) below (val) as 0 for analog mode" << std::endl;
+			std::wcout << "\t--deadzone-y (val) - Treat raw Y axis values (0-255) below (val) as 0 for analog mode" << std::endl;
 			std::wcout << "\t--digital - Turn X and Y axis values into digital instead of analog values. Useful for BMS simulators." << std::endl;
+			std::wcout << "\t--digital-hysteresis (val) - Number of knob counts in one direction needed before the direction is reported in digital mode" << std::endl;
+			std::wcout << "\t--digital-hold-frames (val) - Number of controller frames without movement before an axis returns to center in digital mode, 0 to disable" << std::endl;
+			std::wcout << "\t--digital-hold-us (val) - Time in microseconds without movement before an axis returns to center in digital mode, 0 to disable" << std::endl;
+			std::wcout << "\t--log-level (off|events|raw) - Set what gets logged to the console. raw also dumps every received packet with the time it was sampled" << std::endl;
+			std::wcout << "\t--log-sync - Write log messages directly from the input thread instead of a background thread" << std::endl;
+			std::wcout << "\t--record (file) - Save every notification received from the controller to a capture file" << std::endl;
+			std::wcout << "\t--replay (file) - Feed a capture file to the vJoy device instead of connecting to a controller" << std::endl;
+			std::wcout << "\t--replay-fast - Replay the capture file as fast as possible instead of at the recorded pace" << std::endl;
+			std::wcout << "\t--metrics-interval (sec) - Print latency, report rate and dropped frame statistics every (sec) seconds" << std::endl;
+			std::wcout << "\t--metrics-report (file) - Write the final statistics as JSON to a file on exit" << std::endl;
+			std::wcout << "\t--coalesce-bursts - Only send the final state of a notification with several packets, unless a button press or release would be lost" << std::endl;
+			std::wcout << "\t--no-suppress - Send every report to vJoy even if nothing changed since the last one" << std::endl;
+			std::wcout << "\t--no-vjoy - Count reports instead of sending them to a vJoy device" << std::endl;
+			std::wcout << "\t--shared-memory - Publish the latest state of each controller to a shared memory region named after its vJoy device ID, see sharedstate.h" << std::endl;
+			std::wcout << "\t--controller-cache (file) - Remember connected controllers in (file) and connect to them directly on the next start. Defaults to controllers.cache" << std::endl;
+			std::wcout << "\t--no-controller-cache - Only connect to controllers found by scanning" << std::endl;
+			std::wcout << "\t--wait-strategy (spin|yield|block) - How the feeder thread waits for notifications. spin has the lowest latency but keeps a CPU core busy, yield spins briefly before giving up its time slice, block sleeps until woken up" << std::endl;
+			std::wcout << "\t--scan-filter - Only let the Bluetooth stack report advertisements that include the controller service UUID. Lowers CPU use with many devices nearby, but only works if the controllers advertise the service" << std::endl;
+			std::wcout << "\t--benchmark - Measure decoding and output of synthetic notifications for every device type and burst size, plus the capture from --replay if given, then exit" << std::endl;
+			std::wcout << "\t--benchmark-baseline (file) - Compare the benchmark against a baseline saved with --benchmark-save and exit with an error code on regressions" << std::endl;
+			std::wcout << "\t--benchmark-save (file) - Save the benchmark results as a new baseline" << std::endl;
+			std::wcout << "\t--benchmark-threshold (percent) - Allowed ns/packet increase over the baseline before a case counts as a regression" << std::endl;
+			std::wcout << "\t--remap-profile (file) - Remap buttons and axes with the rules in (file), see remap.cpp for the format" << std::endl;
+			std::wcout << "\t--udp-target (host[:port]) - Stream the state of every controller to another computer running with --udp-listen, the default port is 34580. IPv6 addresses go in brackets: [::1]:34580" << std::endl;
+			std::wcout << "\t--udp-listen (port) - Feed vJoy from controllers streamed by another feeder with --udp-target instead of connecting to any, over IPv4 and IPv6" << std::endl;
 			std::wcout << "\t--help - Display this help message" << std::endl;
 			std::wcout << std::endl;
 			return 0;
@@ -308,22 +546,202 @@ int main(Array<String^>^ args) {
 			auto param = args[argIdx++];
 			vjoyDevId = _wtoi(param->Data());
 		}
+		else if (arg == "--device-map" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			DeviceMapping mapping;
+			if (parseDeviceMapping(param->Data(), mapping)) {
+				deviceMappings.push_back(mapping);
+			}
+			else {
+				std::wcout << "Invalid device mapping!" << param->Data() << std::endl;
+			}
+		}
 		else if (arg == "--sensitivity-x" && argIdx < args->Length) {
 			auto param = args[argIdx++];
-			axisSensitivity[AXIS_X] = _wtof(param->Data());
+			decoderConfig.axisConfig[AXIS_X].sensitivity = _wtof(param->Data());
 		}
 		else if (arg == "--sensitivity-y" && argIdx < args->Length) {
 			auto param = args[argIdx++];
-			axisSensitivity[AXIS_Y] = _wtof(param->Data());
+			decoderConfig.axisConfig[AXIS_Y].sensitivity = _wtof(param->Data());
+		}
+		else if (arg == "--curve-x" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			auto curve = _wtof(param->Data());
+			if (isValidAxisCurve(curve)) {
+				decoderConfig.axisConfig[AXIS_X].curve = curve;
+			}
+			else {
+				std::wcout << "Invalid curve, it has to be greater than 0!" << param->Data() << std::endl;
+			}
+		}
+		else if (arg == "--curve-y" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			auto curve = _wtof(param->Data());
+			if (isValidAxisCurve(curve)) {
+				decoderConfig.axisConfig[AXIS_Y].curve = curve;
+			}
+			else {
+				std::wcout << "Invalid curve, it has to be greater than 0!" << param->Data() << std::endl;
+			}
+		}
+		else if (arg == "--deadzone-x" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			decoderConfig.axisConfig[AXIS_X].deadzone = _wtoi(param->Data());
+		}
+		else if (arg == "--deadzone-y" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			decoderConfig.axisConfig[AXIS_Y].deadzone = _wtoi(param->Data());
 		}
 		else if (arg == "--digital") {
-			isDigital = true;
+			decoderConfig.isDigital = true;
+		}
+		else if (arg == "--digital-hysteresis" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			decoderConfig.motionConfig.hysteresis = _wtoi(param->Data());
+		}
+		else if (arg == "--digital-hold-frames" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			decoderConfig.motionConfig.holdFrames = _wtoi(param->Data());
+		}
+		else if (arg == "--digital-hold-us" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			auto str = param->Data();
+			wchar_t *end;
+			errno = 0;
+			auto holdUs = _wcstoui64(str, &end, 10);
+
+			// _wcstoui64 skips whitespace and negates a leading minus, both would slip through otherwise.
+			// The hold time is compared in nanoseconds, so it also has to fit after multiplying by 1000.
+			if (iswdigit(str[0]) && *end == L'\0' && errno == 0 && holdUs <= UINT64_MAX / 1000) {
+				decoderConfig.motionConfig.holdUs = holdUs;
+			}
+			else {
+				std::wcout << "Invalid hold time, it has to be a whole number of microseconds!" << param->Data() << std::endl;
+			}
+		}
+		else if (arg == "--log-level" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			if (!parseLogLevel(param->Data(), logLevel)) {
+				std::wcout << "Unknown log level!" << param->Data() << std::endl;
+			}
+		}
+		else if (arg == "--log-sync") {
+			isLogSynchronous = true;
+		}
+		else if (arg == "--record" && argIdx < args->Length) {
+			recordPath = args[argIdx++];
+		}
+		else if (arg == "--replay" && argIdx < args->Length) {
+			replayPath = args[argIdx++];
+		}
+		else if (arg == "--replay-fast") {
+			isReplayRealtime = false;
+		}
+		else if (arg == "--metrics-interval" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			metricsInterval = _wtoi(param->Data());
+		}
+		else if (arg == "--metrics-report" && argIdx < args->Length) {
+			metricsReportPath = args[argIdx++];
+		}
+		else if (arg == "--coalesce-bursts") {
+			isCollapsingBursts = true;
+		}
+		else if (arg == "--no-suppress") {
+			isSuppressingDuplicates = false;
+		}
+		else if (arg == "--no-vjoy") {
+			isVjoyEnabled = false;
+		}
+		else if (arg == "--shared-memory") {
+			isSharedMemoryEnabled = true;
+		}
+		else if (arg == "--controller-cache" && argIdx < args->Length) {
+			controllerCachePath = args[argIdx++];
+		}
+		else if (arg == "--no-controller-cache") {
+			controllerCachePath = nullptr;
+		}
+		else if (arg == "--scan-filter") {
+			isScanFilterEnabled = true;
+		}
+		else if (arg == "--benchmark") {
+			isBenchmark = true;
+		}
+		else if (arg == "--benchmark-baseline" && argIdx < args->Length) {
+			benchmarkBaselinePath = args[argIdx++];
+		}
+		else if (arg == "--benchmark-save" && argIdx < args->Length) {
+			benchmarkSavePath = args[argIdx++];
+		}
+		else if (arg == "--benchmark-threshold" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			benchmarkThreshold = _wtof(param->Data());
+		}
+		else if (arg == "--remap-profile" && argIdx < args->Length) {
+			remapProfilePath = args[argIdx++];
+		}
+		else if (arg == "--udp-target" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			if (parseUdpEndpoint(param->Data(), udpTargetHost, udpTargetPort)) {
+				isUdpEnabled = true;
+			}
+			else {
+				std::wcout << "Invalid UDP target!" << param->Data() << std::endl;
+			}
+		}
+		else if (arg == "--udp-listen" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			udpListenPort = _wtoi(param->Data());
+			if (udpListenPort < 1 || udpListenPort > 65535) {
+				std::wcout << "Invalid UDP port!" << param->Data() << std::endl;
+				udpListenPort = 0;
+			}
+		}
+		else if (arg == "--wait-strategy" && argIdx < args->Length) {
+			auto param = args[argIdx++];
+			if (!parseWaitStrategy(param->Data(), waitStrategy)) {
+				std::wcout << "Invalid wait strategy!" << param->Data() << std::endl;
+			}
 		}
 		else {
 			std::wcout << "Unknown argument!" << arg->Data() << std::endl;
 		}
 	}
 
+	if (remapProfilePath != nullptr) {
+		remapProfile.reset(new RemapProfile());
+		if (!loadRemapProfile(remapProfilePath->Data(), *remapProfile)) {
+			std::wcout << "Failed to load remap profile: " << remapProfilePath->Data() << std::endl;
+			return -1;
+		}
+
+		decoderConfig.remapProfile = remapProfile.get();
+		decoderConfig.isMotionTracked = remapProfile->isUsingMotion;
+	}
+
+	buildDecoderTables(decoderConfig);
+
+	if (isBenchmark) {
+		// Logging stays off so the results don't depend on how fast the console is
+		startLogger(LOG_OFF, false);
+
+		BenchmarkOptions options = {
+			replayPath != nullptr ? replayPath->Data() : nullptr,
+			benchmarkBaselinePath != nullptr ? benchmarkBaselinePath->Data() : nullptr,
+			benchmarkSavePath != nullptr ? benchmarkSavePath->Data() : nullptr,
+			benchmarkThreshold,
+			BENCHMARK_DEFAULT_NOTIFICATIONS,
+			nullptr
+		};
+
+		auto ret = runBenchmark(options, decoderConfig);
+		stopLogger();
+		return ret;
+	}
+
+	startLogger(logLevel, isLogSynchronous);
+
 	CoInitializeSecurity(
 		nullptr,
 		-1,
@@ -336,74 +754,157 @@ int main(Array<String^>^ args) {
 		nullptr
 	);
 
-	std::wcout << "Using vJoy device ID: " << vjoyDevId << std::endl;
-
-	if (!vJoyEnabled()) {
+	if (isVjoyEnabled && !vJoyEnabled()) {
 		wprintf(L"Function vJoyEnabled Failed - make sure that vJoy is installed and enabled\n");
 		return -1;
 	}
 
-	VjdStat status = GetVJDStatus(vjoyDevId);
+	if (replayPath != nullptr) {
+		CaptureReader reader;
+		if (!openCaptureReader(reader, replayPath->Data())) {
+			std::wcout << "Failed to open capture file: " << replayPath->Data() << std::endl;
+			stopLogger();
+			return -1;
+		}
 
-	switch (status) {
-	case VJD_STAT_OWN:
-		printf("vJoy device %d is already owned by this feeder\n", vjoyDevId);
-		break;
-	case VJD_STAT_FREE:
-		printf("vJoy device %d is free\n", vjoyDevId);
-		break;
-	case VJD_STAT_BUSY:
-		printf("vJoy device %d is already owned by another feeder\nCannot continue\n", vjoyDevId);
-		return -3;
-	case VJD_STAT_MISS:
-		printf("vJoy device %d is not installed or disabled\nCannot continue\n", vjoyDevId);
-		return -4;
-	default:
-		printf("vJoy device %d general error\nCannot continue\n", vjoyDevId);
-		return -1;
-	};
+		ReplayContext replay = {};
 
-	// Acquire the vJoy device
-	if (!AcquireVJD(vjoyDevId)) {
-		printf("Failed to acquire vJoy device number %d.\n", vjoyDevId);
-		return -1;
-	} else {
-		printf("Acquired device number %d - OK\n", vjoyDevId);
-	}
+		auto stats = replayCapture(reader, isReplayRealtime, replayNotification, &replay);
+		auto elapsedSec = stats.elapsedNs / 1000000000.0;
+		printf("Replayed %llu notifications (%llu packets) in %.3f seconds, %.0f packets/sec\n", stats.notifications, replay.packets, elapsedSec, elapsedSec > 0 ? replay.packets / elapsedSec : 0.0);
 
-	Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher^ bleAdvertisementWatcher = ref new Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher();
-	bleAdvertisementWatcher->ScanningMode = Bluetooth::Advertisement::BluetoothLEScanningMode::Active;
-	bleAdvertisementWatcher->Received += ref new Windows::Foundation::TypedEventHandler<Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher^, Bluetooth::Advertisement::BluetoothLEAdvertisementReceivedEventArgs^>(
-		[bleAdvertisementWatcher](Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher^ watcher, Bluetooth::Advertisement::BluetoothLEAdvertisementReceivedEventArgs^ eventArgs) {
-			if (eventArgs->Advertisement->LocalName != targetDeviceIidx 
-				&& eventArgs->Advertisement->LocalName != targetDeviceSdvx
-				&& eventArgs->Advertisement->LocalName != targetDevicePopn
-				&& eventArgs->Advertisement->LocalName != targetDeviceGitadoraGuitar) {
-				std::wcout << "Skipping device: \"" << eventArgs->Advertisement->LocalName->Data() << "\"" << std::endl;
-				return;
+		for (size_t i = 0; i < controllerRegistry.getControllerCount(); i++) {
+			auto controller = controllerRegistry.getController(i);
+			if (controller->outputSink) {
+				printf("[%d] Output stage sent %llu of %llu reports\n", controller->vjoyDevId, controller->outputSink->forwarded, controller->outputSink->submitted);
 			}
+		}
+
+		printMetrics();
+		writeMetrics();
+
+		closeCaptureReader(reader);
+		relinquishVjoyDevices();
+		stopLogger();
+		return 0;
+	}
+
+	if (udpListenPort != 0) {
+		UdpSocket socket;
+		if (!socket.bind((uint16_t)udpListenPort)) {
+			printf("Failed to listen on UDP port %d\n", udpListenPort);
+			stopLogger();
+			return -1;
+		}
 
-			String^ strAddress = ref new String(formatBluetoothAddress(eventArgs->BluetoothAddress).c_str());
+		printf("Listening for controllers on UDP port %d\n", udpListenPort);
 
-			auto isValid = isValidController(eventArgs->BluetoothAddress);
-			if (isValid.get()) {
-				std::wcout << "Target service found on device: " << strAddress->Data() << " " << eventArgs->Advertisement->LocalName->Data() << std::endl;
+		// The sender has its own clock, so latency is measured against the fastest datagram seen
+		UdpReceiver receiver(createUdpStream, nullptr, false);
+		auto summaryInterval = metricsInterval * 1000000000ull;
+		auto lastSummary = getTimestampNs();
 
-				bleAdvertisementWatcher->Stop();
+		uint8_t datagram[KCF_UDP_MAX_DATAGRAM_LEN];
+		for (;;) {
+			auto len = socket.receive(datagram, sizeof(datagram), 100);
+			auto now = getTimestampNs();
+			if (len > 0) {
+				receiver.processDatagram(datagram, len, now);
+			}
 
-				connectToController(eventArgs->BluetoothAddress, eventArgs->Advertisement->LocalName);
+			if (metricsInterval > 0 && now - lastSummary >= summaryInterval) {
+				lastSummary = now;
+				printUdpMetrics(receiver);
 			}
-			else {
-				std::wcout << "Target service NOT found on device: " << strAddress->Data() << " " << eventArgs->Advertisement->LocalName->Data() << std::endl;
+		}
+	}
+
+	if (recordPath != nullptr) {
+		if (!openCaptureWriter(captureWriter, recordPath->Data())) {
+			std::wcout << "Failed to open capture file: " << recordPath->Data() << std::endl;
+		}
+		else {
+			std::wcout << "Recording notifications to: " << recordPath->Data() << std::endl;
+		}
+	}
+
+	SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
+
+	ConnectionConfig connectionConfig;
+	getDefaultConnectionConfig(connectionConfig);
+	if (controllerCachePath != nullptr) {
+		connectionConfig.cachePath = controllerCachePath->Data();
+	}
+
+	pipeline.reset(new NotificationPipeline(waitStrategy, feedNotification));
+	pipeline->start();
+
+	connectionManager.reset(new ConnectionManager(&bleTransport, connectionConfig));
+	connectionManager->start(getTimestampNs());
+
+	// Keep scanning for the whole lifetime of the feeder so more controllers can be connected at any time
+	Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher^ bleAdvertisementWatcher = ref new Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher();
+	bleAdvertisementWatcher->ScanningMode = Bluetooth::Advertisement::BluetoothLEScanningMode::Active;
+	if (isScanFilterEnabled) {
+		bleAdvertisementWatcher->AdvertisementFilter->Advertisement->ServiceUuids->Append(serviceUUID);
+	}
+	bleAdvertisementWatcher->Received += ref new Windows::Foundation::TypedEventHandler<Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher^, Bluetooth::Advertisement::BluetoothLEAdvertisementReceivedEventArgs^>(
+		[](Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher^ watcher, Bluetooth::Advertisement::BluetoothLEAdvertisementReceivedEventArgs^ eventArgs) {
+			auto name = eventArgs->Advertisement->LocalName;
+			auto isLogged = false;
+			uint64_t suppressedLogs = 0;
+
+			auto deviceType = advertisementFilter.check(eventArgs->BluetoothAddress, name->Data(), name->Length(), getTimestampNs(), isLogged, suppressedLogs);
+			if (deviceType == DeviceType::UNKNOWN) {
+				if (isLogged && suppressedLogs > 0) {
+					std::wcout << "Skipping device: \"" << name->Data() << "\" (" << suppressedLogs << " more skipped since the last message)" << std::endl;
+				}
+				else if (isLogged) {
+					std::wcout << "Skipping device: \"" << name->Data() << "\"" << std::endl;
+				}
+				return;
 			}
+
+			// Ignored unless the controller is new or waiting to reconnect
+			connectionManager->onAdvertisement(eventArgs->BluetoothAddress, deviceType, getTimestampNs());
 		});
 	bleAdvertisementWatcher->Start();
 
+	auto summaryInterval = (metricsInterval > 0 ? metricsInterval : 5) * 1000000000ull;
+	auto lastSummary = getTimestampNs();
+
 	for (;;) {
-		Sleep(5000);
+		Sleep(100);
+
+		auto now = getTimestampNs();
+		connectionManager->update(now);
+		sendUdpIdleKeyframes();
+
+		if (now - lastSummary < summaryInterval) {
+			continue;
+		}
+
+		lastSummary = now;
+		flushCaptureWriter(captureWriter);
+
+		if (metricsInterval > 0) {
+			printMetrics();
+
+			auto filterStats = advertisementFilter.getStats();
+			printf("Advertisements: %llu received, %llu matched, %llu rejected, %llu skipped by cache, %llu without name\n",
+				(unsigned long long)filterStats.advertisements,
+				(unsigned long long)filterStats.matched,
+				(unsigned long long)filterStats.rejected,
+				(unsigned long long)filterStats.cached,
+				(unsigned long long)filterStats.unnamed);
+		}
 	}
 
-	RelinquishVJD(vjoyDevId);
+	pipeline->stop();
+	closeCaptureWriter(captureWriter);
+	writeMetrics();
+	relinquishVjoyDevices();
+	stopLogger();
 
 	return 0;
 }
@@ -0,0 +1,266 @@
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "fileio.h"
+#include "metrics.h"
+
+static int highestBit(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	if (_BitScanReverse(&idx, (unsigned long)(value >> 32))) {
+		return idx + 32;
+	}
+	_BitScanReverse(&idx, (unsigned long)value);
+	return idx;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+static size_t getHistogramBucket(uint64_t value) {
+	if (value < 32) {
+		return (size_t)value;
+	}
+
+	auto msb = highestBit(value);
+	auto subBucket = (size_t)(value >> (msb - 4)); // Top 5 bits, always 16-31
+	return 32 + (msb - 5) * HISTOGRAM_SUB_BUCKETS + (subBucket - HISTOGRAM_SUB_BUCKETS);
+}
+
+// Highest value that maps to the bucket, so percentiles are never under-reported
+static uint64_t getHistogramBucketValue(size_t bucket) {
+	if (bucket < 32) {
+		return bucket;
+	}
+
+	auto msb = (bucket - 32) / HISTOGRAM_SUB_BUCKETS + 5;
+	auto subBucket = (uint64_t)((bucket - 32) % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS);
+	auto shift = msb - 4;
+	return ((subBucket + 1) << shift) - 1;
+}
+
+// Single writer per controller, so plain load/store pairs are enough and avoid locked instructions
+static void increment(std::atomic<uint64_t> &counter, uint64_t value = 1) {
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void resetMetrics(ControllerMetrics &metrics) {
+	for (auto &count : metrics.latencyCounts) {
+		count.store(0, std::memory_order_relaxed);
+	}
+
+	for (auto &count : metrics.burstCounts) {
+		count.store(0, std::memory_order_relaxed);
+	}
+
+	metrics.latencyTotal.store(0, std::memory_order_relaxed);
+	metrics.latencyMax.store(0, std::memory_order_relaxed);
+	metrics.notifications.store(0, std::memory_order_relaxed);
+	metrics.packets.store(0, std::memory_order_relaxed);
+	metrics.firstArrival.store(0, std::memory_order_relaxed);
+	metrics.lastArrival.store(0, std::memory_order_relaxed);
+	metrics.droppedFrames.store(0, std::memory_order_relaxed);
+	metrics.duplicateFrames.store(0, std::memory_order_relaxed);
+	metrics.reorderedFrames.store(0, std::memory_order_relaxed);
+	metrics.lastFrame = -1;
+	metrics.queueDepthMax.store(0, std::memory_order_relaxed);
+	metrics.queueOverflows.store(0, std::memory_order_relaxed);
+	metrics.framePeriodPs.store(0, std::memory_order_relaxed);
+	metrics.summaryPackets = 0;
+	metrics.summaryTime = 0;
+}
+
+void resetFrameTracking(ControllerMetrics &metrics) {
+	metrics.lastFrame = -1;
+}
+
+void recordNotification(ControllerMetrics &metrics, uint64_t arrival, size_t packets) {
+	if (metrics.notifications.load(std::memory_order_relaxed) == 0) {
+		metrics.firstArrival.store(arrival, std::memory_order_relaxed);
+	}
+
+	metrics.lastArrival.store(arrival, std::memory_order_relaxed);
+	increment(metrics.notifications);
+	increment(metrics.packets, packets);
+	increment(metrics.burstCounts[packets < METRICS_MAX_BURST ? packets : METRICS_MAX_BURST]);
+}
+
+void recordFrame(ControllerMetrics &metrics, uint8_t frame) {
+	if (metrics.lastFrame != -1) {
+		// 8-bit counter, anything that looks like a big forward jump is really an older frame arriving late
+		auto delta = (uint8_t)(frame - metrics.lastFrame);
+
+		if (delta == 0) {
+			increment(metrics.duplicateFrames);
+			return;
+		}
+		else if (delta >= 128) {
+			// It was counted as dropped when the gap opened, it isn't anymore
+			auto dropped = metrics.droppedFrames.load(std::memory_order_relaxed);
+			if (dropped > 0) {
+				metrics.droppedFrames.store(dropped - 1, std::memory_order_relaxed);
+			}
+			increment(metrics.reorderedFrames);
+			return;
+		}
+		else if (delta > 1) {
+			increment(metrics.droppedFrames, delta - 1);
+		}
+	}
+
+	metrics.lastFrame = frame;
+}
+
+void recordLatency(ControllerMetrics &metrics, uint64_t latencyNs) {
+	increment(metrics.latencyCounts[getHistogramBucket(latencyNs)]);
+	increment(metrics.latencyTotal, latencyNs);
+
+	if (latencyNs > metrics.latencyMax.load(std::memory_order_relaxed)) {
+		metrics.latencyMax.store(latencyNs, std::memory_order_relaxed);
+	}
+}
+
+void recordQueueDepth(ControllerMetrics &metrics, size_t depth) {
+	if (depth > metrics.queueDepthMax.load(std::memory_order_relaxed)) {
+		metrics.queueDepthMax.store(depth, std::memory_order_relaxed);
+	}
+}
+
+void recordQueueOverflow(ControllerMetrics &metrics) {
+	increment(metrics.queueOverflows);
+}
+
+void recordFramePeriod(ControllerMetrics &metrics, double periodNs) {
+	metrics.framePeriodPs.store((uint64_t)(periodNs * 1000.0), std::memory_order_relaxed);
+}
+
+static uint64_t getPercentileRank(double percentile, uint64_t count) {
+	auto rank = (uint64_t)(percentile * count + 0.5);
+	return rank > 0 ? rank : 1;
+}
+
+MetricsSnapshot getMetricsSnapshot(const ControllerMetrics &metrics) {
+	MetricsSnapshot snapshot = {};
+
+	snapshot.notifications = metrics.notifications.load(std::memory_order_relaxed);
+	snapshot.packets = metrics.packets.load(std::memory_order_relaxed);
+	snapshot.droppedFrames = metrics.droppedFrames.load(std::memory_order_relaxed);
+	snapshot.duplicateFrames = metrics.duplicateFrames.load(std::memory_order_relaxed);
+	snapshot.reorderedFrames = metrics.reorderedFrames.load(std::memory_order_relaxed);
+	snapshot.latencyMax = metrics.latencyMax.load(std::memory_order_relaxed);
+	snapshot.queueDepthMax = metrics.queueDepthMax.load(std::memory_order_relaxed);
+	snapshot.queueOverflows = metrics.queueOverflows.load(std::memory_order_relaxed);
+	snapshot.framePeriodUs = metrics.framePeriodPs.load(std::memory_order_relaxed) / 1000000.0;
+
+	if (snapshot.notifications > 0) {
+		snapshot.packetsPerNotification = (double)snapshot.packets / snapshot.notifications;
+	}
+
+	auto duration = metrics.lastArrival.load(std::memory_order_relaxed) - metrics.firstArrival.load(std::memory_order_relaxed);
+	if (duration > 0 && snapshot.packets > 1) {
+		snapshot.reportRateHz = (snapshot.packets - 1) / (duration / 1000000000.0);
+	}
+
+	uint64_t counts[HISTOGRAM_BUCKETS];
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		counts[i] = metrics.latencyCounts[i].load(std::memory_order_relaxed);
+		snapshot.latencyCount += counts[i];
+	}
+
+	if (snapshot.latencyCount == 0) {
+		return snapshot;
+	}
+
+	snapshot.latencyMean = metrics.latencyTotal.load(std::memory_order_relaxed) / snapshot.latencyCount;
+
+	const double percentiles[] = { 0.5, 0.99, 0.999 };
+	uint64_t *results[] = { &snapshot.latencyP50, &snapshot.latencyP99, &snapshot.latencyP999 };
+	uint64_t seen = 0;
+	size_t percentileIdx = 0;
+
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS && percentileIdx < 3; i++) {
+		seen += counts[i];
+
+		while (percentileIdx < 3 && seen >= getPercentileRank(percentiles[percentileIdx], snapshot.latencyCount)) {
+			auto value = getHistogramBucketValue(i);
+			*results[percentileIdx++] = value < snapshot.latencyMax ? value : snapshot.latencyMax;
+		}
+	}
+
+	return snapshot;
+}
+
+void printMetricsSummary(ControllerMetrics &metrics, int id, uint64_t now) {
+	auto snapshot = getMetricsSnapshot(metrics);
+
+	auto intervalRate = 0.0;
+	if (metrics.summaryTime != 0 && now > metrics.summaryTime) {
+		intervalRate = (snapshot.packets - metrics.summaryPackets) / ((now - metrics.summaryTime) / 1000000000.0);
+	}
+
+	metrics.summaryPackets = snapshot.packets;
+	metrics.summaryTime = now;
+
+	printf("[%d] %.0f reports/s, %.2f packets/notification, latency p50 %.1fus p99 %.1fus p99.9 %.1fus max %.1fus, frames dropped %llu duplicate %llu reordered %llu, queue max depth %llu overflows %llu, frame period %.3fus\n",
+		id,
+		intervalRate,
+		snapshot.packetsPerNotification,
+		snapshot.latencyP50 / 1000.0,
+		snapshot.latencyP99 / 1000.0,
+		snapshot.latencyP999 / 1000.0,
+		snapshot.latencyMax / 1000.0,
+		(unsigned long long)snapshot.droppedFrames,
+		(unsigned long long)snapshot.duplicateFrames,
+		(unsigned long long)snapshot.reorderedFrames,
+		(unsigned long long)snapshot.queueDepthMax,
+		(unsigned long long)snapshot.queueOverflows,
+		snapshot.framePeriodUs);
+}
+
+bool writeMetricsReport(const MetricsReportEntry *entries, size_t count, const wchar_t *path) {
+	auto file = openFile(path, L"w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	fprintf(file, "{\n\t\"controllers\": [");
+
+	for (size_t i = 0; i < count; i++) {
+		auto snapshot = getMetricsSnapshot(*entries[i].metrics);
+
+		fprintf(file, "%s\n\t\t{\n", i > 0 ? "," : "");
+		fprintf(file, "\t\t\t\"id\": %d,\n", entries[i].id);
+		fprintf(file, "\t\t\t\"deviceType\": \"%s\",\n", getDeviceTypeName(entries[i].deviceType));
+		fprintf(file, "\t\t\t\"notifications\": %llu,\n", (unsigned long long)snapshot.notifications);
+		fprintf(file, "\t\t\t\"packets\": %llu,\n", (unsigned long long)snapshot.packets);
+		fprintf(file, "\t\t\t\"packetsPerNotification\": %.4f,\n", snapshot.packetsPerNotification);
+		fprintf(file, "\t\t\t\"reportRateHz\": %.2f,\n", snapshot.reportRateHz);
+		fprintf(file, "\t\t\t\"burstSizes\": [");
+		for (auto burst = 0; burst <= METRICS_MAX_BURST; burst++) {
+			fprintf(file, "%s%llu", burst > 0 ? ", " : "", (unsigned long long)entries[i].metrics->burstCounts[burst].load(std::memory_order_relaxed));
+		}
+		fprintf(file, "],\n");
+		fprintf(file, "\t\t\t\"droppedFrames\": %llu,\n", (unsigned long long)snapshot.droppedFrames);
+		fprintf(file, "\t\t\t\"duplicateFrames\": %llu,\n", (unsigned long long)snapshot.duplicateFrames);
+		fprintf(file, "\t\t\t\"reorderedFrames\": %llu,\n", (unsigned long long)snapshot.reorderedFrames);
+		fprintf(file, "\t\t\t\"queueDepthMax\": %llu,\n", (unsigned long long)snapshot.queueDepthMax);
+		fprintf(file, "\t\t\t\"queueOverflows\": %llu,\n", (unsigned long long)snapshot.queueOverflows);
+		fprintf(file, "\t\t\t\"framePeriodUs\": %.4f,\n", snapshot.framePeriodUs);
+		fprintf(file, "\t\t\t\"latencyNs\": { \"count\": %llu, \"mean\": %llu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu }\n",
+			(unsigned long long)snapshot.latencyCount,
+			(unsigned long long)snapshot.latencyMean,
+			(unsigned long long)snapshot.latencyP50,
+			(unsigned long long)snapshot.latencyP99,
+			(unsigned long long)snapshot.latencyP999,
+			(unsigned long long)snapshot.latencyMax);
+		fprintf(file, "\t\t}");
+	}
+
+	fprintf(file, "\n\t]\n}\n");
+	fclose(file);
+
+	return true;
+}
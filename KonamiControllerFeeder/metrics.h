@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "decoder.h"
+
+// Log-linear histogram in the style of HdrHistogram: values below 32 are exact and every power of 2
+// above that is split into 16 linear sub-buckets, so any recorded value is within ~6% of its bucket
+#define HISTOGRAM_SUB_BUCKETS 16
+#define HISTOGRAM_BUCKETS (32 + (64 - 5) * HISTOGRAM_SUB_BUCKETS)
+
+#define METRICS_MAX_BURST 8
+
+// Written only by the feeder thread, except for the queue counters which are written by the notification
+// callback. Read by the main thread for summaries.
+struct ControllerMetrics {
+	std::atomic<uint64_t> latencyCounts[HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> latencyTotal;
+	std::atomic<uint64_t> latencyMax;
+
+	std::atomic<uint64_t> burstCounts[METRICS_MAX_BURST + 1]; // Last entry counts anything larger
+	std::atomic<uint64_t> notifications;
+	std::atomic<uint64_t> packets;
+	std::atomic<uint64_t> firstArrival;
+	std::atomic<uint64_t> lastArrival;
+
+	std::atomic<uint64_t> droppedFrames;
+	std::atomic<uint64_t> duplicateFrames;
+	std::atomic<uint64_t> reorderedFrames;
+	int lastFrame;
+
+	std::atomic<uint64_t> queueDepthMax;
+	std::atomic<uint64_t> queueOverflows;
+
+	std::atomic<uint64_t> framePeriodPs; // Estimated by the frame clock synchronization, 0 while unknown
+
+	// Only touched by the summary printer
+	uint64_t summaryPackets;
+	uint64_t summaryTime;
+};
+
+struct MetricsSnapshot {
+	uint64_t notifications;
+	uint64_t packets;
+	double packetsPerNotification;
+	double reportRateHz;
+	uint64_t droppedFrames;
+	uint64_t duplicateFrames;
+	uint64_t reorderedFrames;
+	uint64_t queueDepthMax;
+	uint64_t queueOverflows;
+	double framePeriodUs;
+	uint64_t latencyCount;
+	uint64_t latencyMean;
+	uint64_t latencyP50;
+	uint64_t latencyP99;
+	uint64_t latencyP999;
+	uint64_t latencyMax;
+};
+
+struct MetricsReportEntry {
+	int id;
+	DeviceType deviceType;
+	const ControllerMetrics *metrics;
+};
+
+void resetMetrics(ControllerMetrics &metrics);
+
+// After a reconnect, so the new frame counter isn't compared against the old one. The counts are kept.
+void resetFrameTracking(ControllerMetrics &metrics);
+
+void recordNotification(ControllerMetrics &metrics, uint64_t arrival, size_t packets);
+void recordFrame(ControllerMetrics &metrics, uint8_t frame);
+void recordLatency(ControllerMetrics &metrics, uint64_t latencyNs);
+void recordQueueDepth(ControllerMetrics &metrics, size_t depth);
+void recordQueueOverflow(ControllerMetrics &metrics);
+void recordFramePeriod(ControllerMetrics &metrics, double periodNs);
+
+MetricsSnapshot getMetricsSnapshot(const ControllerMetrics &metrics);
+
+void printMetricsSummary(ControllerMetrics &metrics, int id, uint64_t now);
+bool writeMetricsReport(const MetricsReportEntry *entries, size_t count, const wchar_t *path);
@@ -0,0 +1,74 @@
+#include "motion.h"
+
+void resetAxisMotion(AxisMotion &motion) {
+	motion.isInitialized = false;
+	motion.lastRaw = 0;
+	motion.lastFrame = 0;
+	motion.framesSinceMove = 0;
+	motion.lastMoveTime = 0;
+	motion.accumulator = 0;
+	motion.direction = 0;
+}
+
+static int32_t getDirectionValue(int direction) {
+	if (direction > 0) {
+		return MOTION_VALUE_POSITIVE;
+	}
+	else if (direction < 0) {
+		return MOTION_VALUE_NEGATIVE;
+	}
+
+	return MOTION_VALUE_CENTER;
+}
+
+int32_t updateAxisMotion(AxisMotion &motion, const MotionConfig &config, uint8_t raw, uint8_t frame, uint64_t timestamp) {
+	if (!motion.isInitialized) {
+		motion.isInitialized = true;
+		motion.lastRaw = raw;
+		motion.lastFrame = frame;
+		motion.lastMoveTime = timestamp;
+		return getDirectionValue(motion.direction);
+	}
+
+	// Both the position and the frame counter are 8-bit and wrap around, a signed difference
+	// gives the shortest movement between two packets
+	auto delta = (int)(int8_t)(uint8_t)(raw - motion.lastRaw);
+	auto elapsedFrames = (uint8_t)(frame - motion.lastFrame);
+
+	motion.lastRaw = raw;
+	motion.lastFrame = frame;
+
+	if (motion.framesSinceMove < 0xffff) {
+		motion.framesSinceMove += elapsedFrames;
+	}
+
+	if (delta != 0) {
+		auto sign = delta > 0 ? 1 : -1;
+
+		// Any movement against the accumulated direction starts over, so a reversal needs no more
+		// counts than starting from rest
+		if ((motion.accumulator > 0 && sign < 0) || (motion.accumulator < 0 && sign > 0)) {
+			motion.accumulator = 0;
+		}
+
+		motion.accumulator += delta;
+
+		if (motion.accumulator >= config.hysteresis || -motion.accumulator >= config.hysteresis) {
+			motion.direction = sign;
+		}
+
+		motion.framesSinceMove = 0;
+		motion.lastMoveTime = timestamp;
+	}
+	else {
+		auto isHoldFramesExpired = config.holdFrames > 0 && motion.framesSinceMove >= (uint32_t)config.holdFrames;
+		auto isHoldTimeExpired = config.holdUs > 0 && timestamp - motion.lastMoveTime >= config.holdUs * 1000;
+
+		if (isHoldFramesExpired || isHoldTimeExpired) {
+			motion.direction = 0;
+			motion.accumulator = 0;
+		}
+	}
+
+	return getDirectionValue(motion.direction);
+}
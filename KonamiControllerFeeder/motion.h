@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+#define MOTION_DEFAULT_HYSTERESIS 1
+#define MOTION_DEFAULT_HOLD_FRAMES 2
+
+#define MOTION_VALUE_NEGATIVE 0
+#define MOTION_VALUE_CENTER (32768 / 2)
+#define MOTION_VALUE_POSITIVE 32768
+
+struct MotionConfig {
+	int hysteresis; // Knob counts in one direction needed before the direction is reported
+	int holdFrames; // Controller frames without movement before returning to center, 0 to disable
+	uint64_t holdUs; // Host time without movement before returning to center, 0 to disable
+};
+
+// Turns a turntable or knob position into a digital direction. Every packet is evaluated on its own,
+// so direction changes and releases are reported on the same packet they show up in.
+struct AxisMotion {
+	bool isInitialized;
+	uint8_t lastRaw;
+	uint8_t lastFrame;
+	uint32_t framesSinceMove;
+	uint64_t lastMoveTime;
+	int accumulator;
+	int direction;
+};
+
+void resetAxisMotion(AxisMotion &motion);
+
+// Returns the axis value for the current direction
+int32_t updateAxisMotion(AxisMotion &motion, const MotionConfig &config, uint8_t raw, uint8_t frame, uint64_t timestamp);
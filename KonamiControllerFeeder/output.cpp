@@ -0,0 +1,101 @@
+#include "output.h"
+
+static bool isSameState(const FeederReport &a, const FeederReport &b) {
+	// The frame counter isn't part of what the output device sees
+	return a.axisX == b.axisX && a.axisY == b.axisY && a.axisZ == b.axisZ && a.buttons == b.buttons;
+}
+
+void FanoutSink::addSink(std::unique_ptr<OutputSink> sink) {
+	sinks.push_back(std::move(sink));
+}
+
+void FanoutSink::beginBurst() {
+	for (auto &sink : sinks) {
+		sink->beginBurst();
+	}
+}
+
+bool FanoutSink::submit(const FeederReport &report) {
+	auto ret = true;
+	for (auto &sink : sinks) {
+		ret = sink->submit(report) && ret;
+	}
+	return ret;
+}
+
+void FanoutSink::endBurst() {
+	for (auto &sink : sinks) {
+		sink->endBurst();
+	}
+}
+
+CountingSink::CountingSink() : reports(0), lastReport() {
+}
+
+bool CountingSink::submit(const FeederReport &report) {
+	reports++;
+	lastReport = report;
+	return true;
+}
+
+CoalescingSink::CoalescingSink(OutputSink *next, bool isSuppressingDuplicates, bool isCollapsingBursts)
+	: submitted(0), forwarded(0), next(next), isSuppressingDuplicates(isSuppressingDuplicates), isCollapsingBursts(isCollapsingBursts),
+	isInBurst(false), hasLastSent(false), hasPending(false), lastSent(), pending() {
+}
+
+bool CoalescingSink::forward(const FeederReport &report) {
+	if (isSuppressingDuplicates && hasLastSent && isSameState(report, lastSent)) {
+		return true;
+	}
+
+	if (!next->submit(report)) {
+		// Leave lastSent alone so the same state gets retried with the next report
+		return false;
+	}
+
+	forwarded++;
+	lastSent = report;
+	hasLastSent = true;
+
+	return true;
+}
+
+void CoalescingSink::beginBurst() {
+	isInBurst = true;
+	hasPending = false;
+	next->beginBurst();
+}
+
+bool CoalescingSink::submit(const FeederReport &report) {
+	submitted++;
+
+	if (!isCollapsingBursts || !isInBurst) {
+		return forward(report);
+	}
+
+	if (hasPending) {
+		// A button that changed in the pending report and changes back in this one would be lost
+		// if only the final state was sent, so flush the pending report to keep both edges
+		auto pendingEdges = pending.buttons ^ (hasLastSent ? lastSent.buttons : 0);
+		auto newEdges = pending.buttons ^ report.buttons;
+
+		if ((pendingEdges & newEdges) != 0) {
+			forward(pending);
+		}
+	}
+
+	pending = report;
+	hasPending = true;
+
+	return true;
+}
+
+void CoalescingSink::endBurst() {
+	if (hasPending) {
+		forward(pending);
+		hasPending = false;
+	}
+
+	isInBurst = false;
+	next->endBurst();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "decoder.h"
+
+// Everything that consumes decoded reports (vJoy, test stubs, ...) goes through this interface.
+// All packets from one notification are submitted between beginBurst and endBurst.
+class OutputSink {
+public:
+	virtual ~OutputSink() {}
+
+	virtual void beginBurst() {}
+	virtual bool submit(const FeederReport &report) = 0;
+	virtual void endBurst() {}
+};
+
+// Sends every report to several sinks, used when more than one output is enabled
+class FanoutSink : public OutputSink {
+public:
+	void addSink(std::unique_ptr<OutputSink> sink);
+
+	void beginBurst() override;
+	bool submit(const FeederReport &report) override;
+	void endBurst() override;
+
+private:
+	std::vector<std::unique_ptr<OutputSink>> sinks;
+};
+
+// Counts reports instead of sending them anywhere, used for replays without a vJoy device
+class CountingSink : public OutputSink {
+public:
+	CountingSink();
+
+	bool submit(const FeederReport &report) override;
+
+	uint64_t reports;
+	FeederReport lastReport;
+};
+
+// Remembers the last report that was sent downstream and drops reports that wouldn't change anything.
+// When collapsing bursts, only the final state of a notification is sent unless that would hide a
+// button press or release that happened inside the burst.
+class CoalescingSink : public OutputSink {
+public:
+	CoalescingSink(OutputSink *next, bool isSuppressingDuplicates, bool isCollapsingBursts);
+
+	void beginBurst() override;
+	bool submit(const FeederReport &report) override;
+	void endBurst() override;
+
+	uint64_t submitted;
+	uint64_t forwarded;
+
+private:
+	bool forward(const FeederReport &report);
+
+	OutputSink *next;
+	bool isSuppressingDuplicates;
+	bool isCollapsingBursts;
+
+	bool isInBurst;
+	bool hasLastSent;
+	bool hasPending;
+	FeederReport lastSent;
+	FeederReport pending;
+};
@@ -0,0 +1,234 @@
+#include <cstring>
+#include <cwchar>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#include "pipeline.h"
+
+#define PIPELINE_YIELD_SPINS 2000
+
+static void cpuRelax() {
+#if defined(_M_IX86) || defined(_M_X64)
+	_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+bool parseWaitStrategy(const wchar_t *str, WaitStrategy &strategy) {
+	if (wcscmp(str, L"spin") == 0) {
+		strategy = WAIT_SPIN;
+	}
+	else if (wcscmp(str, L"yield") == 0) {
+		strategy = WAIT_YIELD;
+	}
+	else if (wcscmp(str, L"block") == 0) {
+		strategy = WAIT_BLOCK;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+const char *getWaitStrategyName(WaitStrategy strategy) {
+	switch (strategy) {
+	case WAIT_SPIN:
+		return "spin";
+	case WAIT_YIELD:
+		return "yield";
+	case WAIT_BLOCK:
+		return "block";
+	default:
+		return "unknown";
+	}
+}
+
+NotificationQueue::NotificationQueue(void *context) : head(0), cachedTail(0), tail(0), cachedHead(0), context(context) {
+}
+
+bool NotificationQueue::push(const unsigned char *data, size_t len, uint64_t arrival, size_t &depth) {
+	auto currentHead = head.load(std::memory_order_relaxed);
+
+	if (currentHead - cachedTail >= PIPELINE_QUEUE_SLOTS) {
+		cachedTail = tail.load(std::memory_order_acquire);
+		if (currentHead - cachedTail >= PIPELINE_QUEUE_SLOTS) {
+			depth = PIPELINE_QUEUE_SLOTS;
+			return false;
+		}
+	}
+
+	if (len > PIPELINE_MAX_DATA_LEN) {
+		len = PIPELINE_MAX_DATA_LEN;
+	}
+
+	auto &slot = slots[currentHead & (PIPELINE_QUEUE_SLOTS - 1)];
+	slot.arrival = arrival;
+	slot.len = len;
+	memcpy(slot.data, data, len);
+
+	head.store(currentHead + 1, std::memory_order_release);
+
+	// Uses the cached tail, so this is an upper bound rather than the exact depth
+	depth = (size_t)(currentHead + 1 - cachedTail);
+	return true;
+}
+
+const PipelineSlot *NotificationQueue::peek() {
+	auto currentTail = tail.load(std::memory_order_relaxed);
+
+	if (currentTail == cachedHead) {
+		cachedHead = head.load(std::memory_order_acquire);
+		if (currentTail == cachedHead) {
+			return nullptr;
+		}
+	}
+
+	return &slots[currentTail & (PIPELINE_QUEUE_SLOTS - 1)];
+}
+
+void NotificationQueue::pop() {
+	tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void *NotificationQueue::getContext() const {
+	return context;
+}
+
+NotificationPipeline::NotificationPipeline(WaitStrategy strategy, PipelineHandler handler) : strategy(strategy), handler(handler), queueCount(0), isRunning(false), isSleeping(false) {
+}
+
+NotificationPipeline::~NotificationPipeline() {
+	stop();
+}
+
+void NotificationPipeline::start() {
+	if (isRunning.exchange(true)) {
+		return;
+	}
+
+	thread = std::thread(&NotificationPipeline::run, this);
+}
+
+void NotificationPipeline::stop() {
+	if (!isRunning.exchange(false)) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wakeCondition.notify_one();
+	}
+
+	thread.join();
+}
+
+NotificationQueue *NotificationPipeline::addQueue(void *context) {
+	std::lock_guard<std::mutex> lock(queueMutex);
+
+	auto count = queueCount.load(std::memory_order_relaxed);
+	if (count >= PIPELINE_MAX_QUEUES) {
+		return nullptr;
+	}
+
+	queues[count].reset(new NotificationQueue(context));
+	queueCount.store(count + 1, std::memory_order_release);
+
+	return queues[count].get();
+}
+
+bool NotificationPipeline::push(NotificationQueue *queue, const unsigned char *data, size_t len, uint64_t arrival, size_t &depth) {
+	if (!queue->push(data, len, arrival, depth)) {
+		return false;
+	}
+
+	if (strategy == WAIT_BLOCK) {
+		// Pairs with the fence in wait, either the feeder sees the new slot or we see it going to sleep
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (isSleeping.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			wakeCondition.notify_one();
+		}
+	}
+
+	return true;
+}
+
+void NotificationPipeline::run() {
+	uint32_t idleCount = 0;
+
+	while (isRunning.load(std::memory_order_relaxed)) {
+		if (drain()) {
+			idleCount = 0;
+		}
+		else {
+			wait(idleCount);
+		}
+	}
+
+	drain();
+}
+
+bool NotificationPipeline::drain() {
+	auto didWork = false;
+	auto count = queueCount.load(std::memory_order_acquire);
+
+	for (size_t i = 0; i < count; i++) {
+		auto queue = queues[i].get();
+
+		const PipelineSlot *slot;
+		while ((slot = queue->peek()) != nullptr) {
+			handler(queue->getContext(), slot->data, slot->len, slot->arrival);
+			queue->pop();
+			didWork = true;
+		}
+	}
+
+	return didWork;
+}
+
+bool NotificationPipeline::hasPending() {
+	auto count = queueCount.load(std::memory_order_acquire);
+
+	for (size_t i = 0; i < count; i++) {
+		if (queues[i]->peek() != nullptr) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void NotificationPipeline::wait(uint32_t &idleCount) {
+	switch (strategy) {
+	case WAIT_SPIN:
+		cpuRelax();
+		break;
+	case WAIT_YIELD:
+		if (idleCount < PIPELINE_YIELD_SPINS) {
+			idleCount++;
+			cpuRelax();
+		}
+		else {
+			std::this_thread::yield();
+		}
+		break;
+	case WAIT_BLOCK:
+	{
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		isSleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		// Producers notify under the same mutex, so nothing pushed after this check can be missed
+		if (!hasPending() && isRunning.load(std::memory_order_relaxed)) {
+			wakeCondition.wait(lock);
+		}
+
+		isSleeping.store(false, std::memory_order_relaxed);
+		break;
+	}
+	}
+}
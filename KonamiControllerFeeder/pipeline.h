@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define PIPELINE_MAX_QUEUES 16
+#define PIPELINE_QUEUE_SLOTS 256 // Power of 2
+#define PIPELINE_MAX_DATA_LEN 512
+#define PIPELINE_CACHE_LINE 64
+
+// Spin: busy wait, lowest latency but keeps a core at 100%
+// Yield: busy wait for a short while, then give up the time slice between checks
+// Block: sleep on a condition variable, producers only pay for a wakeup when the feeder is asleep
+enum WaitStrategy {
+	WAIT_SPIN,
+	WAIT_YIELD,
+	WAIT_BLOCK
+};
+
+bool parseWaitStrategy(const wchar_t *str, WaitStrategy &strategy);
+const char *getWaitStrategyName(WaitStrategy strategy);
+
+struct PipelineSlot {
+	uint64_t arrival;
+	size_t len;
+	unsigned char data[PIPELINE_MAX_DATA_LEN];
+};
+
+// Pre-allocated single-producer/single-consumer ring. The producer is the notification callback of one
+// controller, the consumer is the feeder thread. Head and tail live on separate cache lines and each
+// side keeps a cached copy of the other side's index so it only touches the shared line when it has to.
+class NotificationQueue {
+public:
+	explicit NotificationQueue(void *context);
+
+	// Producer side, returns false and counts an overflow if the ring is full
+	bool push(const unsigned char *data, size_t len, uint64_t arrival, size_t &depth);
+
+	// Consumer side, the slot stays valid until pop
+	const PipelineSlot *peek();
+	void pop();
+
+	void *getContext() const;
+
+private:
+	std::atomic<uint64_t> head;
+	uint64_t cachedTail;
+	char headPadding[PIPELINE_CACHE_LINE - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+
+	std::atomic<uint64_t> tail;
+	uint64_t cachedHead;
+	char tailPadding[PIPELINE_CACHE_LINE - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+
+	void *context;
+	PipelineSlot slots[PIPELINE_QUEUE_SLOTS];
+};
+
+typedef void (*PipelineHandler)(void *context, const unsigned char *data, size_t len, uint64_t arrival);
+
+// Hands notifications from any number of producer queues to one feeder thread that decodes and outputs them
+class NotificationPipeline {
+public:
+	NotificationPipeline(WaitStrategy strategy, PipelineHandler handler);
+	~NotificationPipeline();
+
+	void start();
+	void stop();
+
+	// Queues are only ever added, so the returned pointer stays valid for the lifetime of the pipeline.
+	// The context is passed to the handler for every notification from this queue.
+	NotificationQueue *addQueue(void *context);
+
+	// Producer side, wakes up the feeder thread if needed
+	bool push(NotificationQueue *queue, const unsigned char *data, size_t len, uint64_t arrival, size_t &depth);
+
+private:
+	void run();
+	bool drain();
+	bool hasPending();
+	void wait(uint32_t &idleCount);
+
+	WaitStrategy strategy;
+	PipelineHandler handler;
+
+	std::unique_ptr<NotificationQueue> queues[PIPELINE_MAX_QUEUES];
+	std::atomic<size_t> queueCount;
+	std::mutex queueMutex;
+
+	std::atomic<bool> isRunning;
+	std::atomic<bool> isSleeping;
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::thread thread;
+};
@@ -0,0 +1,418 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "fileio.h"
+#include "remap.h"
+
+/*
+Profile format, one rule per line, # starts a comment:
+
+[iidx]                  Rules after a section only apply to that device type (iidx, sdvx, popn, gitadora),
+                        rules before the first section apply to every device type
+button 1 = button 3     Input buttons 1-16 in the order of the report, output buttons 1-32
+button 2 = none         Buttons without a rule keep their number, none drops them
+button 9 = axis x+      Holds the axis at its maximum (x-, y+, ...) while pressed, opposite directions cancel out.
+                        The rest of the time the axis shows its input, or what's routed to it
+axis z > 200 = button 10  Axis values are scaled to 0-255, in digital mode 0 is minus and 255 is plus
+motion x- = button 11   Turntable/knob direction (x-, x+, y-, y+), follows --digital-hysteresis and the hold settings
+axis x = axis y         Route an axis to another one, axes without a rule stay where they are
+*/
+
+struct RemapSection {
+	const char *name;
+	DeviceType deviceType;
+};
+
+static const RemapSection remapSections[] = {
+	{ "[iidx]", DeviceType::IIDX },
+	{ "[sdvx]", DeviceType::SDVX },
+	{ "[popn]", DeviceType::POPN },
+	{ "[gitadora]", DeviceType::GITADORA_GUITAR },
+};
+
+#define REMAP_MAX_TOKENS 8
+
+static size_t splitTokens(char *line, char **tokens) {
+	size_t count = 0;
+	auto pos = line;
+
+	for (;;) {
+		while (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n') {
+			pos++;
+		}
+
+		if (*pos == 0 || *pos == '#') {
+			return count;
+		}
+
+		if (count == REMAP_MAX_TOKENS) {
+			return REMAP_MAX_TOKENS + 1;
+		}
+
+		tokens[count++] = pos;
+		while (*pos != 0 && *pos != ' ' && *pos != '\t' && *pos != '\r' && *pos != '\n' && *pos != '#') {
+			pos++;
+		}
+
+		if (*pos == '#') {
+			*pos = 0;
+			return count;
+		}
+
+		if (*pos != 0) {
+			*pos++ = 0;
+		}
+	}
+}
+
+static bool parseNumber(const char *str, int min, int max, int &value) {
+	char *end;
+	auto number = strtol(str, &end, 10);
+	if (end == str || *end != 0 || number < min || number > max) {
+		return false;
+	}
+
+	value = (int)number;
+	return true;
+}
+
+// "x", "y" or "z", optionally followed by a direction. direction is 0 without one, -1 for "-" and 1 for "+".
+static bool parseAxis(const char *str, int &axis, int &direction) {
+	if (str[0] < 'x' || str[0] > 'z') {
+		return false;
+	}
+
+	axis = str[0] - 'x';
+	direction = 0;
+
+	if (str[1] == '-' || str[1] == '+') {
+		direction = str[1] == '-' ? -1 : 1;
+		return str[2] == 0;
+	}
+
+	return str[1] == 0;
+}
+
+static bool parseInput(char **tokens, size_t count, RemapRule &rule) {
+	auto direction = 0;
+
+	if (count == 2 && strcmp(tokens[0], "button") == 0) {
+		rule.input = REMAP_FROM_BUTTON;
+		if (!parseNumber(tokens[1], 1, REMAP_INPUT_BUTTONS, rule.inputIdx)) {
+			return false;
+		}
+		rule.inputIdx--;
+		return true;
+	}
+	else if ((count == 2 || count == 4) && strcmp(tokens[0], "axis") == 0) {
+		if (!parseAxis(tokens[1], rule.inputIdx, direction) || direction != 0) {
+			return false;
+		}
+
+		if (count == 2) {
+			rule.input = REMAP_FROM_AXIS;
+			return true;
+		}
+
+		if (strcmp(tokens[2], "<") == 0) {
+			rule.input = REMAP_FROM_AXIS_BELOW;
+		}
+		else if (strcmp(tokens[2], ">") == 0) {
+			rule.input = REMAP_FROM_AXIS_ABOVE;
+		}
+		else {
+			return false;
+		}
+
+		return parseNumber(tokens[3], 0, 255, rule.threshold);
+	}
+	else if (count == 2 && strcmp(tokens[0], "motion") == 0) {
+		// Only the turntable and the knobs have a direction
+		if (!parseAxis(tokens[1], rule.inputIdx, direction) || direction == 0 || rule.inputIdx > 1) {
+			return false;
+		}
+
+		rule.input = REMAP_FROM_MOTION;
+		rule.inputIdx = rule.inputIdx * 2 + (direction > 0 ? 1 : 0);
+		return true;
+	}
+
+	return false;
+}
+
+static bool parseOutput(char **tokens, size_t count, RemapRule &rule) {
+	auto direction = 0;
+
+	if (count == 1 && strcmp(tokens[0], "none") == 0) {
+		rule.output = REMAP_TO_NONE;
+		return true;
+	}
+	else if (count == 2 && strcmp(tokens[0], "button") == 0) {
+		rule.output = REMAP_TO_BUTTON;
+		if (!parseNumber(tokens[1], 1, REMAP_OUTPUT_BUTTONS, rule.outputIdx)) {
+			return false;
+		}
+		rule.outputIdx--;
+		return true;
+	}
+	else if (count == 2 && strcmp(tokens[0], "axis") == 0) {
+		if (!parseAxis(tokens[1], rule.outputIdx, direction)) {
+			return false;
+		}
+
+		rule.output = direction == 0 ? REMAP_TO_AXIS : direction < 0 ? REMAP_TO_AXIS_NEGATIVE : REMAP_TO_AXIS_POSITIVE;
+		return true;
+	}
+
+	return false;
+}
+
+static bool parseRemapLine(char *line, DeviceType &section, std::vector<RemapRule> &rules) {
+	char *tokens[REMAP_MAX_TOKENS];
+	auto count = splitTokens(line, tokens);
+	if (count == 0) {
+		return true;
+	}
+	else if (count > REMAP_MAX_TOKENS) {
+		return false;
+	}
+
+	if (count == 1 && tokens[0][0] == '[') {
+		for (auto &entry : remapSections) {
+			if (strcmp(tokens[0], entry.name) == 0) {
+				section = entry.deviceType;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	size_t separator = 0;
+	while (separator < count && strcmp(tokens[separator], "=") != 0) {
+		separator++;
+	}
+
+	if (separator == count) {
+		return false;
+	}
+
+	RemapRule rule = {};
+	rule.deviceType = section;
+	if (!parseInput(tokens, separator, rule) || !parseOutput(tokens + separator + 1, count - separator - 1, rule)) {
+		return false;
+	}
+
+	// Routing only makes sense from an axis to an axis
+	auto isRouting = rule.input == REMAP_FROM_AXIS;
+	if (isRouting && rule.output != REMAP_TO_AXIS && rule.output != REMAP_TO_NONE) {
+		return false;
+	}
+	else if (!isRouting && rule.output == REMAP_TO_AXIS) {
+		return false;
+	}
+
+	rules.push_back(rule);
+	return true;
+}
+
+bool loadRemapProfile(const wchar_t *path, RemapProfile &profile) {
+	auto file = openFile(path, L"r");
+	if (file == nullptr) {
+		return false;
+	}
+
+	std::vector<RemapRule> rules;
+	auto section = DeviceType::UNKNOWN;
+	auto isValid = true;
+	auto lineNumber = 0;
+
+	char line[256];
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		lineNumber++;
+		if (!parseRemapLine(line, section, rules)) {
+			printf("Invalid remap rule on line %d\n", lineNumber);
+			isValid = false;
+		}
+	}
+
+	fclose(file);
+
+	if (!isValid) {
+		return false;
+	}
+
+	compileRemapProfile(rules, profile);
+	return true;
+}
+
+static bool isRuleActive(const RemapRule &rule, int source, unsigned int value) {
+	switch (rule.input) {
+	case REMAP_FROM_BUTTON:
+		return source == REMAP_SOURCE_BUTTONS_LOW + rule.inputIdx / 8 && ((value >> (rule.inputIdx % 8)) & 1) != 0;
+	case REMAP_FROM_AXIS_BELOW:
+		return source == REMAP_SOURCE_AXIS_X + rule.inputIdx && value < (unsigned int)rule.threshold;
+	case REMAP_FROM_AXIS_ABOVE:
+		return source == REMAP_SOURCE_AXIS_X + rule.inputIdx && value > (unsigned int)rule.threshold;
+	case REMAP_FROM_MOTION:
+		return source == REMAP_SOURCE_MOTION && ((value >> rule.inputIdx) & 1) != 0;
+	default:
+		return false;
+	}
+}
+
+static void addRuleOutput(const RemapRule &rule, RemapEntry &entry) {
+	switch (rule.output) {
+	case REMAP_TO_BUTTON:
+		entry.buttons |= 1u << rule.outputIdx;
+		break;
+	case REMAP_TO_AXIS_NEGATIVE:
+		entry.axisOffset[rule.outputIdx] -= MOTION_VALUE_CENTER - MOTION_VALUE_NEGATIVE;
+		entry.axisOverride |= 1u << rule.outputIdx;
+		break;
+	case REMAP_TO_AXIS_POSITIVE:
+		entry.axisOffset[rule.outputIdx] += MOTION_VALUE_POSITIVE - MOTION_VALUE_CENTER;
+		entry.axisOverride |= 1u << rule.outputIdx;
+		break;
+	default:
+		break;
+	}
+}
+
+static void compileRemapTable(const std::vector<RemapRule> &rules, DeviceType deviceType, RemapTable &table) {
+	memset(&table, 0, sizeof(table));
+
+	// Knob devices report axes in the vJoy range, the others pass the raw bytes through
+	table.axisShift = deviceType == DeviceType::IIDX || deviceType == DeviceType::SDVX ? 7 : 0;
+
+	std::vector<const RemapRule *> active;
+	bool isButtonMapped[REMAP_INPUT_BUTTONS] = {};
+	bool isAxisRouted[REMAP_AXES] = {};
+	int axisRoute[REMAP_AXES] = { -1, -1, -1 };
+
+	for (auto &rule : rules) {
+		if (rule.deviceType != DeviceType::UNKNOWN && rule.deviceType != deviceType) {
+			continue;
+		}
+
+		active.push_back(&rule);
+
+		if (rule.input == REMAP_FROM_BUTTON) {
+			isButtonMapped[rule.inputIdx] = true;
+		}
+		else if (rule.input == REMAP_FROM_AXIS) {
+			isAxisRouted[rule.inputIdx] = true;
+			if (rule.output == REMAP_TO_AXIS) {
+				axisRoute[rule.outputIdx] = rule.inputIdx;
+			}
+		}
+	}
+
+	// Rules that push an axis only take over while they're active, see axisOverride
+	for (auto axis = 0; axis < REMAP_AXES; axis++) {
+		if (axisRoute[axis] >= 0) {
+			table.axisSource[axis] = axisRoute[axis];
+		}
+		else {
+			table.axisSource[axis] = isAxisRouted[axis] ? -1 : axis;
+		}
+	}
+
+	for (auto source = 0; source < REMAP_SOURCES; source++) {
+		for (unsigned int value = 0; value < 256; value++) {
+			auto &entry = table.entries[source][value];
+
+			if (source == REMAP_SOURCE_BUTTONS_LOW || source == REMAP_SOURCE_BUTTONS_HIGH) {
+				for (auto bit = 0; bit < 8; bit++) {
+					auto button = (source - REMAP_SOURCE_BUTTONS_LOW) * 8 + bit;
+					if (!isButtonMapped[button] && ((value >> bit) & 1) != 0) {
+						entry.buttons |= 1u << button;
+					}
+				}
+			}
+
+			for (auto rule : active) {
+				if (isRuleActive(*rule, source, value)) {
+					addRuleOutput(*rule, entry);
+				}
+			}
+		}
+	}
+}
+
+void compileRemapProfile(const std::vector<RemapRule> &rules, RemapProfile &profile) {
+	profile.isUsingMotion = false;
+	for (auto &rule : rules) {
+		if (rule.input == REMAP_FROM_MOTION) {
+			profile.isUsingMotion = true;
+		}
+	}
+
+	for (auto deviceType = 0; deviceType < REMAP_DEVICE_TYPES; deviceType++) {
+		compileRemapTable(rules, (DeviceType)deviceType, profile.tables[deviceType]);
+	}
+}
+
+const RemapTable *getRemapTable(const RemapProfile &profile, DeviceType deviceType) {
+	if (deviceType <= DeviceType::UNKNOWN || deviceType >= REMAP_DEVICE_TYPES) {
+		return nullptr;
+	}
+
+	return &profile.tables[deviceType];
+}
+
+static uint8_t getAxisSourceValue(int32_t value, int shift) {
+	auto scaled = value >> shift;
+	return (uint8_t)(scaled < 0 ? 0 : scaled > 255 ? 255 : scaled);
+}
+
+static uint8_t getMotionSourceValue(const DecoderState &state) {
+	uint8_t value = 0;
+	for (auto axisIdx = 0; axisIdx <= AXIS_Y - AXIS_X; axisIdx++) {
+		auto direction = state.motion[AXIS_X + axisIdx].direction;
+		if (direction != 0) {
+			value |= 1 << (axisIdx * 2 + (direction > 0 ? 1 : 0));
+		}
+	}
+	return value;
+}
+
+void applyRemap(const RemapTable &table, const DecoderState &state, FeederReport &report) {
+	int32_t axes[REMAP_AXES] = { report.axisX, report.axisY, report.axisZ };
+
+	uint8_t sources[REMAP_SOURCES];
+	sources[REMAP_SOURCE_BUTTONS_LOW] = (uint8_t)report.buttons;
+	sources[REMAP_SOURCE_BUTTONS_HIGH] = (uint8_t)(report.buttons >> 8);
+	for (auto axis = 0; axis < REMAP_AXES; axis++) {
+		sources[REMAP_SOURCE_AXIS_X + axis] = getAxisSourceValue(axes[axis], table.axisShift);
+	}
+	sources[REMAP_SOURCE_MOTION] = getMotionSourceValue(state);
+
+	uint32_t buttons = 0;
+	uint32_t overrides = 0;
+	int32_t offsets[REMAP_AXES] = {};
+	for (auto source = 0; source < REMAP_SOURCES; source++) {
+		auto &entry = table.entries[source][sources[source]];
+		buttons |= entry.buttons;
+		overrides |= entry.axisOverride;
+		for (auto axis = 0; axis < REMAP_AXES; axis++) {
+			offsets[axis] += entry.axisOffset[axis];
+		}
+	}
+
+	int32_t values[REMAP_AXES];
+	for (auto axis = 0; axis < REMAP_AXES; axis++) {
+		if (table.axisSource[axis] >= 0 && ((overrides >> axis) & 1) == 0) {
+			values[axis] = axes[table.axisSource[axis]];
+		}
+		else {
+			auto value = MOTION_VALUE_CENTER + offsets[axis];
+			values[axis] = value < MOTION_VALUE_NEGATIVE ? MOTION_VALUE_NEGATIVE : value > MOTION_VALUE_POSITIVE ? MOTION_VALUE_POSITIVE : value;
+		}
+	}
+
+	report.axisX = values[0];
+	report.axisY = values[1];
+	report.axisZ = values[2];
+	report.buttons = buttons;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "decoder.h"
+
+#define REMAP_INPUT_BUTTONS 16
+#define REMAP_OUTPUT_BUTTONS 32
+#define REMAP_AXES 3
+#define REMAP_DEVICE_TYPES (DeviceType::GITADORA_GUITAR + 1)
+
+// Every packet is reduced to these bytes, each of which picks one precomputed table entry
+#define REMAP_SOURCE_BUTTONS_LOW 0
+#define REMAP_SOURCE_BUTTONS_HIGH 1
+#define REMAP_SOURCE_AXIS_X 2 // Followed by Y and Z, the report axes scaled to 0-255
+#define REMAP_SOURCE_MOTION 5 // Direction of the turntable/knobs: x-, x+, y-, y+ in bits 0-3
+#define REMAP_SOURCES 6
+
+enum RemapInput {
+	REMAP_FROM_BUTTON, // index is the input button
+	REMAP_FROM_AXIS_BELOW, // index is the axis, true while its 0-255 value is below threshold
+	REMAP_FROM_AXIS_ABOVE,
+	REMAP_FROM_AXIS, // Route the axis as is, only to REMAP_TO_AXIS
+	REMAP_FROM_MOTION, // index is the motion bit
+};
+
+enum RemapOutput {
+	REMAP_TO_BUTTON, // index is the output button
+	REMAP_TO_AXIS_NEGATIVE, // Pushes the axis towards its minimum while the input is active
+	REMAP_TO_AXIS_POSITIVE,
+	REMAP_TO_AXIS,
+	REMAP_TO_NONE,
+};
+
+// One line of a profile. Buttons and axes are 0-based here, the profile file counts buttons from 1.
+struct RemapRule {
+	DeviceType deviceType; // DeviceType::UNKNOWN applies to every device type
+	RemapInput input;
+	int inputIdx;
+	int threshold;
+	RemapOutput output;
+	int outputIdx;
+};
+
+struct RemapEntry {
+	uint32_t buttons;
+	int32_t axisOffset[REMAP_AXES];
+	uint32_t axisOverride; // Bit per axis that an active rule pushes, those are built from the offsets
+};
+
+struct RemapTable {
+	RemapEntry entries[REMAP_SOURCES][256];
+	int axisSource[REMAP_AXES]; // Input axis copied to each output axis while no rule pushes it, -1 for the center
+	int axisShift; // Scales a report axis of this device type to 0-255
+};
+
+// Compiled once at startup, so applying a profile costs the same few lookups per packet no matter how many rules it has
+struct RemapProfile {
+	bool isUsingMotion; // The decoder has to track the knob direction even in analog mode
+	RemapTable tables[REMAP_DEVICE_TYPES];
+};
+
+// Prints the line number of anything it can't parse
+bool loadRemapProfile(const wchar_t *path, RemapProfile &profile);
+
+void compileRemapProfile(const std::vector<RemapRule> &rules, RemapProfile &profile);
+
+const RemapTable *getRemapTable(const RemapProfile &profile, DeviceType deviceType);
+
+void applyRemap(const RemapTable &table, const DecoderState &state, FeederReport &report);
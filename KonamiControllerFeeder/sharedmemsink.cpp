@@ -0,0 +1,100 @@
+#include <atomic>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "sharedmemsink.h"
+
+SharedMemorySink::SharedMemorySink(unsigned int id, DeviceType deviceType) : state(nullptr), mappingHandle(nullptr) {
+#ifdef _WIN32
+	snprintf(name, sizeof(name), "Local\\%s%u", KCF_SHARED_STATE_NAME_PREFIX, id);
+
+	auto mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(KcfSharedState), name);
+	if (mapping == nullptr) {
+		return;
+	}
+
+	auto view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(KcfSharedState));
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		return;
+	}
+
+	mappingHandle = mapping;
+#else
+	snprintf(name, sizeof(name), "/%s%u", KCF_SHARED_STATE_NAME_PREFIX, id);
+
+	auto fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		return;
+	}
+
+	if (ftruncate(fd, sizeof(KcfSharedState)) != 0) {
+		close(fd);
+		return;
+	}
+
+	auto view = mmap(nullptr, sizeof(KcfSharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (view == MAP_FAILED) {
+		return;
+	}
+#endif
+
+	state = (volatile KcfSharedState*)view;
+	state->sequence = 0;
+	state->magic = KCF_SHARED_STATE_MAGIC;
+	state->version = KCF_SHARED_STATE_VERSION;
+	state->deviceType = deviceType;
+	state->updateCount = 0;
+}
+
+SharedMemorySink::~SharedMemorySink() {
+	if (state == nullptr) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile((const void*)state);
+	CloseHandle((HANDLE)mappingHandle);
+#else
+	munmap((void*)state, sizeof(KcfSharedState));
+	shm_unlink(name);
+#endif
+}
+
+bool SharedMemorySink::isOpen() const {
+	return state != nullptr;
+}
+
+bool SharedMemorySink::submit(const FeederReport &report) {
+	if (state == nullptr) {
+		return false;
+	}
+
+	// Seqlock writer: make the sequence odd before touching the state and even again afterwards.
+	// There is only ever one writer per region so the sequence doesn't need an atomic increment.
+	auto sequence = state->sequence;
+	state->sequence = sequence + 1;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	state->axisX = report.axisX;
+	state->axisY = report.axisY;
+	state->axisZ = report.axisZ;
+	state->buttons = report.buttons;
+	state->frame = report.frame;
+	state->timestamp = report.timestamp;
+	state->updateCount = state->updateCount + 1;
+
+	std::atomic_thread_fence(std::memory_order_release);
+	state->sequence = sequence + 2;
+
+	return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "output.h"
+#include "sharedstate.h"
+
+// Publishes the latest report to a named shared memory region so other processes can poll
+// the controller state without going through vJoy, see sharedstate.h for the layout
+class SharedMemorySink : public OutputSink {
+public:
+	SharedMemorySink(unsigned int id, DeviceType deviceType);
+	~SharedMemorySink();
+
+	bool isOpen() const;
+	bool submit(const FeederReport &report) override;
+
+private:
+	volatile KcfSharedState *state;
+	void *mappingHandle;
+	char name[64];
+};
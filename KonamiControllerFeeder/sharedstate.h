@@ -0,0 +1,87 @@
+/*
+Shared memory layout used by the --shared-memory output of KonamiControllerFeeder.
+This header is plain C so other tools can include it directly to read controller state.
+
+One region is created per controller, named after its vJoy device ID:
+Windows: "Local\KonamiControllerFeeder<id>" opened with OpenFileMappingW/MapViewOfFile
+Others:  "/KonamiControllerFeeder<id>" opened with shm_open/mmap
+
+The writer protects the state with a seqlock. sequence is odd while an update is in progress,
+so readers retry until they see the same even sequence before and after copying the state.
+updateCount goes up by one for every published report, a jump of more than one between two
+reads means the reader missed updates.
+*/
+
+#ifndef KCF_SHARED_STATE_H
+#define KCF_SHARED_STATE_H
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define KCF_SHARED_STATE_MAGIC 0x5343464b /* "KFCS" */
+#define KCF_SHARED_STATE_VERSION 1
+#define KCF_SHARED_STATE_NAME_PREFIX "KonamiControllerFeeder"
+#define KCF_SHARED_STATE_MAX_RETRIES 1000
+
+#if defined(_MSC_VER)
+/* x86 and x64 never reorder loads with other loads, only the compiler has to be stopped */
+#define KCF_READ_BARRIER() _ReadWriteBarrier()
+#else
+#define KCF_READ_BARRIER() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+typedef struct KcfSharedState {
+	uint32_t magic;
+	uint32_t version;
+	volatile uint32_t sequence;
+	uint32_t deviceType;
+
+	/* Everything below is only consistent when read under the seqlock */
+	int32_t axisX;
+	int32_t axisY;
+	int32_t axisZ;
+	uint32_t buttons;
+	uint32_t frame;
+	uint32_t reserved;
+	uint64_t timestamp; /* Host monotonic clock at the time the controller sampled the packet, nanoseconds */
+	uint64_t updateCount;
+} KcfSharedState;
+
+/* Returns 1 and fills out with a consistent copy, or 0 if the writer kept updating for too long */
+static inline int kcfReadSharedState(const volatile KcfSharedState *shared, KcfSharedState *out) {
+	int retries;
+
+	for (retries = 0; retries < KCF_SHARED_STATE_MAX_RETRIES; retries++) {
+		uint32_t before = shared->sequence;
+		KCF_READ_BARRIER();
+
+		if (before & 1) {
+			continue;
+		}
+
+		out->magic = shared->magic;
+		out->version = shared->version;
+		out->deviceType = shared->deviceType;
+		out->axisX = shared->axisX;
+		out->axisY = shared->axisY;
+		out->axisZ = shared->axisZ;
+		out->buttons = shared->buttons;
+		out->frame = shared->frame;
+		out->reserved = 0;
+		out->timestamp = shared->timestamp;
+		out->updateCount = shared->updateCount;
+
+		KCF_READ_BARRIER();
+		if (shared->sequence == before) {
+			out->sequence = before;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Monotonic host timestamp in nanoseconds
+inline uint64_t getTimestampNs() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,84 @@
+/*
+Datagram format used by the --udp-target output of KonamiControllerFeeder, see udpreceiver.h for a
+receiver. Every field is little-endian and there's no padding.
+
+Header (25 bytes):
+u32 magic         KCF_UDP_MAGIC
+u8  version       KCF_UDP_VERSION
+u8  flags         KCF_UDP_FLAG_*
+u8  streamId      vJoy device ID of the controller on the sending side
+u8  deviceType    DeviceType of the controller
+u32 session       Picked by the sender when it starts, a new session means the sender started over
+u32 sequence      Goes up by one for every datagram of a stream, a gap means datagrams were lost
+u64 sendTime      Sender monotonic clock in nanoseconds when the datagram was sent
+u8  reportCount   Number of reports that follow, all packets of one notification share a datagram
+
+Report:
+u8  fields        KCF_UDP_FIELD_* of the values that changed since the previous report of the stream
+u8  frame         Controller frame counter
+u32 age           sendTime minus the time the controller sampled the report, nanoseconds
+u16 axisX         Only if KCF_UDP_FIELD_AXIS_X is set
+u16 axisY         Only if KCF_UDP_FIELD_AXIS_Y is set
+u16 axisZ         Only if KCF_UDP_FIELD_AXIS_Z is set
+u32 buttons       Only if KCF_UDP_FIELD_BUTTONS is set
+
+The first report of a keyframe datagram has every field set, so a receiver that lost datagrams
+can start over from there. Everything else is a delta against the report before it. A new session
+starts from its first keyframe, whatever its sequence is compared to the old one.
+
+While the controller state doesn't change there are no reports to send, so the sender repeats the
+last report as a keyframe with KCF_UDP_FLAG_IDLE every keyframe interval. It carries no new sample,
+receivers only use it to fix their state and leave it out of frame and latency statistics.
+*/
+
+#ifndef KCF_UDP_PROTOCOL_H
+#define KCF_UDP_PROTOCOL_H
+
+#include <stdint.h>
+
+#define KCF_UDP_MAGIC 0x5546434b /* "KCFU" */
+#define KCF_UDP_VERSION 2
+#define KCF_UDP_DEFAULT_PORT 34580
+
+#define KCF_UDP_HEADER_LEN 25
+#define KCF_UDP_MAX_REPORTS 32
+#define KCF_UDP_MAX_REPORT_LEN 16
+#define KCF_UDP_MAX_DATAGRAM_LEN (KCF_UDP_HEADER_LEN + KCF_UDP_MAX_REPORTS * KCF_UDP_MAX_REPORT_LEN)
+
+#define KCF_UDP_FLAG_KEYFRAME 0x01
+#define KCF_UDP_FLAG_IDLE 0x02
+
+#define KCF_UDP_FIELD_AXIS_X 0x01
+#define KCF_UDP_FIELD_AXIS_Y 0x02
+#define KCF_UDP_FIELD_AXIS_Z 0x04
+#define KCF_UDP_FIELD_BUTTONS 0x08
+#define KCF_UDP_FIELD_ALL 0x0f
+
+static inline void kcfUdpPut16(uint8_t *p, uint16_t value) {
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static inline void kcfUdpPut32(uint8_t *p, uint32_t value) {
+	kcfUdpPut16(p, (uint16_t)value);
+	kcfUdpPut16(p + 2, (uint16_t)(value >> 16));
+}
+
+static inline void kcfUdpPut64(uint8_t *p, uint64_t value) {
+	kcfUdpPut32(p, (uint32_t)value);
+	kcfUdpPut32(p + 4, (uint32_t)(value >> 32));
+}
+
+static inline uint16_t kcfUdpGet16(const uint8_t *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t kcfUdpGet32(const uint8_t *p) {
+	return kcfUdpGet16(p) | ((uint32_t)kcfUdpGet16(p + 2) << 16);
+}
+
+static inline uint64_t kcfUdpGet64(const uint8_t *p) {
+	return kcfUdpGet32(p) | ((uint64_t)kcfUdpGet32(p + 4) << 32);
+}
+
+#endif
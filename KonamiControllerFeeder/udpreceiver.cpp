@@ -0,0 +1,216 @@
+#include "udpreceiver.h"
+
+struct UdpReportRecord {
+	uint8_t fields;
+	uint8_t frame;
+	uint32_t age;
+	uint16_t axes[3];
+	uint32_t buttons;
+};
+
+// Checks the whole datagram before anything is applied, so a truncated one can't leave half an update behind
+static bool parseReports(const uint8_t *data, size_t len, size_t count, UdpReportRecord *records) {
+	auto pos = data;
+	auto end = data + len;
+
+	for (size_t i = 0; i < count; i++) {
+		auto &record = records[i];
+		if (end - pos < 6) {
+			return false;
+		}
+
+		record.fields = pos[0];
+		record.frame = pos[1];
+		record.age = kcfUdpGet32(pos + 2);
+		pos += 6;
+
+		if (record.fields & ~KCF_UDP_FIELD_ALL) {
+			return false;
+		}
+
+		for (auto axis = 0; axis < 3; axis++) {
+			if (record.fields & (KCF_UDP_FIELD_AXIS_X << axis)) {
+				if (end - pos < 2) {
+					return false;
+				}
+				record.axes[axis] = kcfUdpGet16(pos);
+				pos += 2;
+			}
+		}
+
+		if (record.fields & KCF_UDP_FIELD_BUTTONS) {
+			if (end - pos < 4) {
+				return false;
+			}
+			record.buttons = kcfUdpGet32(pos);
+			pos += 4;
+		}
+	}
+
+	return pos == end;
+}
+
+UdpReceiver::UdpReceiver(UdpStreamFunc streamFunc, void *context, bool isClockShared) : malformedDatagrams(0), streamFunc(streamFunc), context(context), isClockShared(isClockShared) {
+}
+
+UdpReceiver::Stream *UdpReceiver::getStream(unsigned int id, DeviceType deviceType) {
+	auto &stream = streams[id];
+	if (!stream) {
+		stream.reset(new Stream());
+		stream->sink = streamFunc != nullptr ? streamFunc(context, id, deviceType) : nullptr;
+		stream->deviceType = deviceType;
+		stream->isSynced = false;
+		stream->hasSequence = false;
+		stream->session = 0;
+		stream->lastSequence = 0;
+		stream->hasClockOffset = false;
+		stream->clockOffset = 0;
+		stream->state = FeederReport();
+		stream->stats = UdpStreamStats();
+		resetMetrics(stream->metrics);
+	}
+
+	return stream.get();
+}
+
+bool UdpReceiver::processDatagram(const uint8_t *data, size_t len, uint64_t now) {
+	if (len < KCF_UDP_HEADER_LEN || kcfUdpGet32(data) != KCF_UDP_MAGIC || data[4] != KCF_UDP_VERSION) {
+		malformedDatagrams++;
+		return false;
+	}
+
+	auto flags = data[5];
+	auto id = data[6];
+	auto deviceType = data[7];
+	auto session = kcfUdpGet32(data + 8);
+	auto sequence = kcfUdpGet32(data + 12);
+	auto sendTime = kcfUdpGet64(data + 16);
+	size_t count = data[24];
+
+	UdpReportRecord records[KCF_UDP_MAX_REPORTS];
+	if (deviceType > DeviceType::GITADORA_GUITAR || count > KCF_UDP_MAX_REPORTS || !parseReports(data + KCF_UDP_HEADER_LEN, len - KCF_UDP_HEADER_LEN, count, records)) {
+		malformedDatagrams++;
+		return false;
+	}
+
+	auto stream = getStream(id, (DeviceType)deviceType);
+	stream->stats.datagrams++;
+
+	auto isKeyframe = (flags & KCF_UDP_FLAG_KEYFRAME) != 0 && count > 0 && records[0].fields == KCF_UDP_FIELD_ALL;
+	auto isIdle = isKeyframe && (flags & KCF_UDP_FLAG_IDLE) != 0;
+
+	// A sender that started over has a new session and its sequence has nothing to do with the old one.
+	// Its deltas are useless until its first keyframe arrives.
+	if (stream->hasSequence && session != stream->session) {
+		if (!isKeyframe) {
+			stream->stats.skippedReports += count;
+			return true;
+		}
+
+		stream->stats.restarts++;
+		stream->hasSequence = false;
+		stream->hasClockOffset = false;
+		resetFrameTracking(stream->metrics);
+	}
+
+	// Deltas only make sense applied in order, anything older than what was already applied is useless
+	if (stream->hasSequence) {
+		auto gap = (int32_t)(sequence - stream->lastSequence);
+		if (gap <= 0) {
+			stream->stats.lateDatagrams++;
+			return true;
+		}
+		else if (gap > 1) {
+			stream->stats.lostDatagrams += gap - 1;
+			stream->isSynced = false;
+		}
+	}
+
+	stream->hasSequence = true;
+	stream->session = session;
+	stream->lastSequence = sequence;
+
+	if (isIdle) {
+		stream->stats.idleKeyframes++;
+		stream->isSynced = true;
+	}
+	else if (isKeyframe) {
+		stream->stats.keyframes++;
+		stream->isSynced = true;
+	}
+	else if (!stream->isSynced) {
+		stream->stats.skippedReports += count;
+		return true;
+	}
+
+	if (!isClockShared) {
+		auto offset = (int64_t)(now - sendTime);
+		if (!stream->hasClockOffset || offset < stream->clockOffset) {
+			stream->clockOffset = offset;
+			stream->hasClockOffset = true;
+		}
+	}
+
+	// The repeated report is as old as the last change, its frame and age say nothing about the link
+	if (!isIdle) {
+		recordNotification(stream->metrics, now, count);
+	}
+
+	if (stream->sink != nullptr) {
+		stream->sink->beginBurst();
+	}
+
+	auto &state = stream->state;
+	for (size_t i = 0; i < count; i++) {
+		auto &record = records[i];
+
+		if (record.fields & KCF_UDP_FIELD_AXIS_X) {
+			state.axisX = record.axes[0];
+		}
+		if (record.fields & KCF_UDP_FIELD_AXIS_Y) {
+			state.axisY = record.axes[1];
+		}
+		if (record.fields & KCF_UDP_FIELD_AXIS_Z) {
+			state.axisZ = record.axes[2];
+		}
+		if (record.fields & KCF_UDP_FIELD_BUTTONS) {
+			state.buttons = record.buttons;
+		}
+
+		state.frame = record.frame;
+		state.timestamp = sendTime - record.age + stream->clockOffset;
+
+		if (!isIdle) {
+			stream->stats.reports++;
+			recordFrame(stream->metrics, state.frame);
+			recordLatency(stream->metrics, now > state.timestamp ? now - state.timestamp : 0);
+		}
+
+		if (stream->sink != nullptr) {
+			stream->sink->submit(state);
+		}
+	}
+
+	if (stream->sink != nullptr) {
+		stream->sink->endBurst();
+	}
+
+	return true;
+}
+
+bool UdpReceiver::getState(unsigned int id, FeederReport &report) const {
+	if (id >= UDP_MAX_STREAMS || !streams[id] || streams[id]->stats.keyframes + streams[id]->stats.idleKeyframes == 0) {
+		return false;
+	}
+
+	report = streams[id]->state;
+	return true;
+}
+
+const UdpStreamStats *UdpReceiver::getStreamStats(unsigned int id) const {
+	return id < UDP_MAX_STREAMS && streams[id] ? &streams[id]->stats : nullptr;
+}
+
+ControllerMetrics *UdpReceiver::getStreamMetrics(unsigned int id) {
+	return id < UDP_MAX_STREAMS && streams[id] ? &streams[id]->metrics : nullptr;
+}
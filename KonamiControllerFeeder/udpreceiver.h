@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "decoder.h"
+#include "metrics.h"
+#include "output.h"
+#include "udpprotocol.h"
+
+#define UDP_MAX_STREAMS 256
+
+struct UdpStreamStats {
+	uint64_t datagrams;
+	uint64_t reports;
+	uint64_t keyframes;
+	uint64_t idleKeyframes; // Repeats of an unchanged state, not counted in reports
+	uint64_t restarts; // The sender started a new session
+	uint64_t lostDatagrams; // Gaps in the sequence
+	uint64_t lateDatagrams; // Older than one already received, dropped
+	uint64_t skippedReports; // Received while waiting for a keyframe after a loss
+};
+
+// Called the first time a stream shows up, returns where its reports should go or nullptr to ignore them
+typedef OutputSink *(*UdpStreamFunc)(void *context, unsigned int id, DeviceType deviceType);
+
+// Rebuilds the controller state from the datagrams of a UdpSink, one stream per sending controller.
+// Without a shared clock (isClockShared false) latency is measured against the fastest datagram seen so
+// far, which hides the constant part of the network delay but still shows jitter and queueing.
+class UdpReceiver {
+public:
+	UdpReceiver(UdpStreamFunc streamFunc, void *context, bool isClockShared);
+
+	// now is the receiver monotonic clock in nanoseconds. Returns false for anything that isn't a valid datagram.
+	bool processDatagram(const uint8_t *data, size_t len, uint64_t now);
+
+	// Latest state of a stream, false until the stream got its first keyframe
+	bool getState(unsigned int id, FeederReport &report) const;
+
+	// nullptr for streams that never sent anything. Metrics cover latency, frame drops and burst sizes.
+	const UdpStreamStats *getStreamStats(unsigned int id) const;
+	ControllerMetrics *getStreamMetrics(unsigned int id);
+
+	uint64_t malformedDatagrams;
+
+private:
+	struct Stream {
+		OutputSink *sink;
+		DeviceType deviceType;
+		bool isSynced;
+		bool hasSequence;
+		uint32_t session;
+		uint32_t lastSequence;
+		bool hasClockOffset;
+		int64_t clockOffset; // Added to sender timestamps to get receiver time
+		FeederReport state;
+		UdpStreamStats stats;
+		ControllerMetrics metrics;
+	};
+
+	Stream *getStream(unsigned int id, DeviceType deviceType);
+
+	UdpStreamFunc streamFunc;
+	void *context;
+	bool isClockShared;
+	std::unique_ptr<Stream> streams[UDP_MAX_STREAMS];
+};
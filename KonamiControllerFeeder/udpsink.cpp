@@ -0,0 +1,140 @@
+#include "timing.h"
+#include "udpsink.h"
+
+UdpSink::UdpSink(const char *host, uint16_t port, unsigned int id, DeviceType deviceType, uint64_t keyframeIntervalMs) :
+	datagrams(0),
+	sendErrors(0),
+	id((uint8_t)id),
+	deviceType((uint8_t)deviceType),
+	session((uint32_t)getTimestampNs()), // Only has to differ from the previous run of the sender
+	keyframeIntervalNs(keyframeIntervalMs * 1000000ull),
+	isInBurst(false),
+	hasLastReport(false),
+	lastReport(),
+	sequence(0),
+	lastKeyframeTime(0),
+	lastKeyframeSequence(0),
+	pendingCount(0) {
+	socket.connect(host, port);
+}
+
+bool UdpSink::isOpen() const {
+	return socket.isOpen();
+}
+
+void UdpSink::beginBurst() {
+	std::lock_guard<std::mutex> lock(mutex);
+	isInBurst = true;
+}
+
+bool UdpSink::submit(const FeederReport &report) {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending[pendingCount++] = report;
+
+	// Reports outside of a burst go out right away
+	if (!isInBurst || pendingCount == KCF_UDP_MAX_REPORTS) {
+		return flush(false);
+	}
+
+	return true;
+}
+
+void UdpSink::endBurst() {
+	std::lock_guard<std::mutex> lock(mutex);
+	isInBurst = false;
+
+	if (pendingCount > 0) {
+		flush(false);
+	}
+}
+
+void UdpSink::sendIdleKeyframe() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// A burst in progress sends its own datagram soon enough
+	if (!hasLastReport || isInBurst || pendingCount > 0 || getTimestampNs() - lastKeyframeTime < keyframeIntervalNs) {
+		return;
+	}
+
+	pending[0] = lastReport;
+	pendingCount = 1;
+	flush(true);
+}
+
+static uint16_t getAxisValue(int32_t value) {
+	return (uint16_t)(value < 0 ? 0 : value > 0xffff ? 0xffff : value);
+}
+
+bool UdpSink::flush(bool isIdle) {
+	auto now = getTimestampNs();
+	auto isKeyframe = isIdle || !hasLastReport || sequence - lastKeyframeSequence >= UDP_KEYFRAME_DATAGRAMS || now - lastKeyframeTime >= keyframeIntervalNs;
+
+	uint8_t datagram[KCF_UDP_MAX_DATAGRAM_LEN];
+	kcfUdpPut32(datagram, KCF_UDP_MAGIC);
+	datagram[4] = KCF_UDP_VERSION;
+	datagram[5] = (isKeyframe ? KCF_UDP_FLAG_KEYFRAME : 0) | (isIdle ? KCF_UDP_FLAG_IDLE : 0);
+	datagram[6] = id;
+	datagram[7] = deviceType;
+	kcfUdpPut32(datagram + 8, session);
+	kcfUdpPut32(datagram + 12, sequence);
+	kcfUdpPut64(datagram + 16, now);
+	datagram[24] = (uint8_t)pendingCount;
+
+	auto pos = datagram + KCF_UDP_HEADER_LEN;
+	for (size_t i = 0; i < pendingCount; i++) {
+		auto &report = pending[i];
+
+		uint8_t fields = KCF_UDP_FIELD_ALL;
+		if (!(i == 0 && isKeyframe)) {
+			fields = 0;
+			fields |= getAxisValue(report.axisX) != getAxisValue(lastReport.axisX) ? KCF_UDP_FIELD_AXIS_X : 0;
+			fields |= getAxisValue(report.axisY) != getAxisValue(lastReport.axisY) ? KCF_UDP_FIELD_AXIS_Y : 0;
+			fields |= getAxisValue(report.axisZ) != getAxisValue(lastReport.axisZ) ? KCF_UDP_FIELD_AXIS_Z : 0;
+			fields |= report.buttons != lastReport.buttons ? KCF_UDP_FIELD_BUTTONS : 0;
+		}
+
+		auto age = now > report.timestamp ? now - report.timestamp : 0;
+
+		*pos++ = fields;
+		*pos++ = report.frame;
+		kcfUdpPut32(pos, (uint32_t)(age < 0xffffffffull ? age : 0xffffffffull));
+		pos += 4;
+
+		if (fields & KCF_UDP_FIELD_AXIS_X) {
+			kcfUdpPut16(pos, getAxisValue(report.axisX));
+			pos += 2;
+		}
+		if (fields & KCF_UDP_FIELD_AXIS_Y) {
+			kcfUdpPut16(pos, getAxisValue(report.axisY));
+			pos += 2;
+		}
+		if (fields & KCF_UDP_FIELD_AXIS_Z) {
+			kcfUdpPut16(pos, getAxisValue(report.axisZ));
+			pos += 2;
+		}
+		if (fields & KCF_UDP_FIELD_BUTTONS) {
+			kcfUdpPut32(pos, report.buttons);
+			pos += 4;
+		}
+
+		lastReport = report;
+	}
+
+	hasLastReport = true;
+	if (isKeyframe) {
+		lastKeyframeTime = now;
+		lastKeyframeSequence = sequence;
+	}
+
+	sequence++;
+	pendingCount = 0;
+	datagrams++;
+
+	// A lost datagram is no different from one dropped on the network, the next keyframe fixes it
+	if (!socket.send(datagram, pos - datagram)) {
+		sendErrors++;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <mutex>
+
+#include "output.h"
+#include "udpprotocol.h"
+#include "udpsocket.h"
+
+#define UDP_DEFAULT_KEYFRAME_INTERVAL_MS 100
+#define UDP_KEYFRAME_DATAGRAMS 8 // Keyframe at least every this many datagrams, limits what one lost datagram costs at high rates
+
+// Streams reports to another host, see udpprotocol.h for the format. All reports of a burst go out in
+// one datagram and only the values that changed are sent, with a full keyframe every few datagrams or
+// keyframe interval, whichever comes first, so a receiver recovers from lost datagrams.
+// Duplicate reports are suppressed before they get here, so a held state has to be repeated by
+// sendIdleKeyframe, which is called from another thread.
+class UdpSink : public OutputSink {
+public:
+	UdpSink(const char *host, uint16_t port, unsigned int id, DeviceType deviceType, uint64_t keyframeIntervalMs);
+
+	bool isOpen() const;
+
+	void beginBurst() override;
+	bool submit(const FeederReport &report) override;
+	void endBurst() override;
+
+	// Repeats the last report as an idle keyframe if no keyframe went out for a keyframe interval.
+	// Call it more often than that, the feeder does it from its main loop.
+	void sendIdleKeyframe();
+
+	uint64_t datagrams;
+	uint64_t sendErrors;
+
+private:
+	bool flush(bool isIdle);
+
+	std::mutex mutex; // Only ever contended by sendIdleKeyframe
+	UdpSocket socket;
+	uint8_t id;
+	uint8_t deviceType;
+	uint32_t session;
+	uint64_t keyframeIntervalNs;
+
+	bool isInBurst;
+	bool hasLastReport;
+	FeederReport lastReport; // Last report that was sent, the base for the next delta
+	uint32_t sequence;
+	uint64_t lastKeyframeTime;
+	uint32_t lastKeyframeSequence;
+
+	// Reports are only encoded when the datagram is sent, so their age is relative to the actual send time
+	FeederReport pending[KCF_UDP_MAX_REPORTS];
+	size_t pendingCount;
+};
@@ -0,0 +1,256 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "udpsocket.h"
+
+#ifdef _WIN32
+#define INVALID_HANDLE ((intptr_t)INVALID_SOCKET)
+
+struct WinsockInit {
+	WinsockInit() {
+		WSADATA data;
+		isInitialized = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+
+	~WinsockInit() {
+		if (isInitialized) {
+			WSACleanup();
+		}
+	}
+
+	bool isInitialized;
+};
+
+static bool initSockets() {
+	static WinsockInit init;
+	return init.isInitialized;
+}
+#else
+#define INVALID_HANDLE ((intptr_t)-1)
+
+static bool initSockets() {
+	return true;
+}
+#endif
+
+UdpSocket::UdpSocket() : handle(INVALID_HANDLE) {
+}
+
+UdpSocket::~UdpSocket() {
+	close();
+}
+
+bool UdpSocket::create(int family) {
+	close();
+
+	if (!initSockets()) {
+		return false;
+	}
+
+	// INVALID_SOCKET and -1 both end up as -1
+	handle = (intptr_t)socket(family, SOCK_DGRAM, IPPROTO_UDP);
+	return handle != INVALID_HANDLE;
+}
+
+void UdpSocket::close() {
+	if (handle == INVALID_HANDLE) {
+		return;
+	}
+
+#ifdef _WIN32
+	closesocket((SOCKET)handle);
+#else
+	::close((int)handle);
+#endif
+
+	handle = INVALID_HANDLE;
+}
+
+bool UdpSocket::connect(const char *host, uint16_t port) {
+	if (!initSockets()) {
+		return false;
+	}
+
+	char service[8];
+	snprintf(service, sizeof(service), "%u", port);
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	addrinfo *result = nullptr;
+	if (getaddrinfo(host, service, &hints, &result) != 0) {
+		return false;
+	}
+
+	auto isConnected = false;
+	for (auto info = result; info != nullptr && !isConnected; info = info->ai_next) {
+		if (!create(info->ai_family)) {
+			continue;
+		}
+
+#ifdef _WIN32
+		isConnected = ::connect((SOCKET)handle, info->ai_addr, (int)info->ai_addrlen) == 0;
+#else
+		isConnected = ::connect((int)handle, info->ai_addr, info->ai_addrlen) == 0;
+#endif
+	}
+
+	freeaddrinfo(result);
+
+	if (!isConnected) {
+		close();
+	}
+
+	return isConnected;
+}
+
+bool UdpSocket::bind(uint16_t port) {
+	if (create(AF_INET6)) {
+		// Off by default on Windows, and on Linux it depends on net.ipv6.bindv6only
+		int isV6Only = 0;
+		sockaddr_in6 address6 = {};
+		address6.sin6_family = AF_INET6;
+		address6.sin6_addr = in6addr_any;
+		address6.sin6_port = htons(port);
+
+#ifdef _WIN32
+		auto isBound = setsockopt((SOCKET)handle, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&isV6Only, sizeof(isV6Only)) == 0
+			&& ::bind((SOCKET)handle, (const sockaddr*)&address6, sizeof(address6)) == 0;
+#else
+		auto isBound = setsockopt((int)handle, IPPROTO_IPV6, IPV6_V6ONLY, &isV6Only, sizeof(isV6Only)) == 0
+			&& ::bind((int)handle, (const sockaddr*)&address6, sizeof(address6)) == 0;
+#endif
+
+		if (isBound) {
+			return true;
+		}
+	}
+
+	// No IPv6 on this system, or the socket can't take IPv4 as well
+	if (!create(AF_INET)) {
+		return false;
+	}
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+#ifdef _WIN32
+	auto isBound = ::bind((SOCKET)handle, (const sockaddr*)&address, sizeof(address)) == 0;
+#else
+	auto isBound = ::bind((int)handle, (const sockaddr*)&address, sizeof(address)) == 0;
+#endif
+
+	if (!isBound) {
+		close();
+	}
+
+	return isBound;
+}
+
+bool UdpSocket::isOpen() const {
+	return handle != INVALID_HANDLE;
+}
+
+bool UdpSocket::send(const uint8_t *data, size_t len) {
+	if (handle == INVALID_HANDLE) {
+		return false;
+	}
+
+#ifdef _WIN32
+	return ::send((SOCKET)handle, (const char*)data, (int)len, 0) == (int)len;
+#else
+	return ::send((int)handle, data, len, 0) == (ssize_t)len;
+#endif
+}
+
+int UdpSocket::receive(uint8_t *data, size_t len, int timeoutMs) {
+	if (handle == INVALID_HANDLE) {
+		return -1;
+	}
+
+	fd_set readSet;
+	FD_ZERO(&readSet);
+#ifdef _WIN32
+	FD_SET((SOCKET)handle, &readSet);
+#else
+	FD_SET((int)handle, &readSet);
+#endif
+
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+	// The first argument is ignored by Winsock
+	auto ready = select((int)handle + 1, &readSet, nullptr, nullptr, &timeout);
+	if (ready <= 0) {
+		return ready;
+	}
+
+#ifdef _WIN32
+	return recv((SOCKET)handle, (char*)data, (int)len, 0);
+#else
+	return (int)recv((int)handle, data, len, 0);
+#endif
+}
+
+bool parseUdpEndpoint(const wchar_t *str, std::string &host, uint16_t &port) {
+	// A colon that isn't the last one belongs to an IPv6 address, which then has to be in brackets to carry a port
+	auto separator = wcsrchr(str, L':');
+	auto isBracketed = str[0] == L'[';
+	if (separator != nullptr && !isBracketed && wcschr(str, L':') != separator) {
+		separator = nullptr;
+	}
+	else if (separator != nullptr && isBracketed && separator[-1] != L']') {
+		separator = nullptr;
+	}
+
+	auto hostEnd = separator != nullptr ? separator : str + wcslen(str);
+	auto hostStart = str;
+	if (isBracketed) {
+		hostStart++;
+		if (hostEnd[-1] != L']') {
+			return false;
+		}
+		hostEnd--;
+	}
+
+	if (hostEnd <= hostStart) {
+		return false;
+	}
+
+	host.clear();
+	for (auto c = hostStart; c < hostEnd; c++) {
+		if (*c > 0x7f) {
+			return false;
+		}
+		host += (char)*c;
+	}
+
+	if (separator != nullptr) {
+		wchar_t *end;
+		auto value = wcstol(separator + 1, &end, 10);
+		if (end == separator + 1 || *end != 0 || value < 1 || value > 65535) {
+			return false;
+		}
+		port = (uint16_t)value;
+	}
+
+	return true;
+}
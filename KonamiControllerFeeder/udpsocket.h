@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Thin wrapper around a Winsock or BSD socket, just enough for the UDP output and receiver
+class UdpSocket {
+public:
+	UdpSocket();
+	~UdpSocket();
+
+	// Sender side, the socket is connected so every datagram goes to the same host
+	bool connect(const char *host, uint16_t port);
+
+	// Receiver side, listens on all interfaces. IPv4 and IPv6 where the system allows a dual-stack socket,
+	// IPv4 only otherwise.
+	bool bind(uint16_t port);
+
+	bool isOpen() const;
+	bool send(const uint8_t *data, size_t len);
+
+	// Waits up to timeoutMs for a datagram. Returns its length, 0 on timeout and -1 on errors.
+	int receive(uint8_t *data, size_t len, int timeoutMs);
+
+private:
+	bool create(int family);
+	void close();
+
+	intptr_t handle;
+};
+
+// "host:port" or "host", in which case port is left as is
+bool parseUdpEndpoint(const wchar_t *str, std::string &host, uint16_t &port);
@@ -0,0 +1,27 @@
+#include <Windows.h>
+
+#include <vjoyinterface.h>
+
+#include "logger.h"
+#include "vjoysink.h"
+
+VJoySink::VJoySink(unsigned int deviceId) : deviceId(deviceId) {
+}
+
+bool VJoySink::submit(const FeederReport &report) {
+	JOYSTICK_POSITION iReport = {};
+	iReport.bDevice = (BYTE)deviceId;
+	iReport.wAxisX = report.axisX;
+	iReport.wAxisY = report.axisY;
+	iReport.wAxisZ = report.axisZ;
+	iReport.lButtons = report.buttons;
+
+	// Send position data to vJoy device
+	if (!UpdateVJD(deviceId, &iReport)) {
+		logError("Feeding vJoy device number %u failed - try to enable device\n", deviceId);
+		AcquireVJD(deviceId);
+		return false;
+	}
+
+	return true;
+}
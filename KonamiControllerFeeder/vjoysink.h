@@ -0,0 +1,13 @@
+#pragma once
+
+#include "output.h"
+
+class VJoySink : public OutputSink {
+public:
+	VJoySink(unsigned int deviceId);
+
+	bool submit(const FeederReport &report) override;
+
+private:
+	unsigned int deviceId;
+};
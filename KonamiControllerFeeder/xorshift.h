@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// xorshift32, for synthetic streams and tests that only have to be repeatable, not random. state must not be 0.
+inline uint32_t nextRandom(uint32_t &state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
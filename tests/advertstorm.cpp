@@ -0,0 +1,140 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "advertfilter.h"
+#include "alloccount.h"
+#include "check.h"
+#include "timing.h"
+
+// A busy room: lots of phones, headphones and watches advertising several times a second while a
+// controller sends an unnamed advertisement before every scan response. The filter has to find the
+// controller every time, keep the log quiet and spend almost nothing on everything else.
+
+#define STORM_DEVICES 200
+#define STORM_TICKS 600 // 60 s of advertisements at 10 per second
+#define STORM_TICK_NS 100000000ull
+#define STORM_CONTROLLER_ADDRESS 0x112233445566ull
+
+static void testNames() {
+	CHECK(getDeviceTypeFromName(L"IIDX Entry model", 16) == DeviceType::IIDX);
+	CHECK(getDeviceTypeFromName(L"SDVX Entry Model", 16) == DeviceType::SDVX);
+	CHECK(getDeviceTypeFromName(L"Pop'n controller", 16) == DeviceType::POPN);
+	CHECK(getDeviceTypeFromName(L"GITADORA controller", 19) == DeviceType::GITADORA_GUITAR);
+
+	// Case, length and non-ASCII first characters must not match
+	CHECK(getDeviceTypeFromName(L"IIDX Entry Model", 16) == DeviceType::UNKNOWN);
+	CHECK(getDeviceTypeFromName(L"IIDX Entry mode", 15) == DeviceType::UNKNOWN);
+	CHECK(getDeviceTypeFromName(L"IIDX Entry models", 17) == DeviceType::UNKNOWN);
+	CHECK(getDeviceTypeFromName(L"\x0149IDX Entry model", 16) == DeviceType::UNKNOWN);
+	CHECK(getDeviceTypeFromName(L"", 0) == DeviceType::UNKNOWN);
+}
+
+static void testStorm() {
+	AdvertisementFilter filter;
+
+	std::vector<std::wstring> names;
+	for (auto i = 0; i < STORM_DEVICES; i++) {
+		names.push_back(L"Phone " + std::to_wstring(i));
+	}
+
+	auto logged = 0;
+	uint64_t suppressedTotal = 0;
+	auto found = 0;
+	auto now = 1000000000ull;
+	auto allocations = countAllocations();
+	auto start = getTimestampNs();
+
+	for (auto tick = 0; tick < STORM_TICKS; tick++, now += STORM_TICK_NS) {
+		bool isLogged;
+		uint64_t suppressed;
+
+		for (auto i = 0; i < STORM_DEVICES; i++) {
+			// Every third device only ever sends unnamed advertisements
+			auto &name = names[i];
+			auto isUnnamed = i % 3 == 0;
+			auto deviceType = filter.check(0xaa0000000000ull + i * 7, name.c_str(), isUnnamed ? 0 : name.size(), now, isLogged, suppressed);
+			CHECK(deviceType == DeviceType::UNKNOWN);
+
+			logged += isLogged;
+			suppressedTotal += suppressed;
+		}
+
+		// The unnamed advertisement of the controller must not get it cached as rejected
+		if (filter.check(STORM_CONTROLLER_ADDRESS, L"", 0, now, isLogged, suppressed) == DeviceType::UNKNOWN
+			&& filter.check(STORM_CONTROLLER_ADDRESS, L"SDVX Entry Model", 16, now, isLogged, suppressed) == DeviceType::SDVX) {
+			found++;
+		}
+	}
+
+	auto elapsed = getTimestampNs() - start;
+	allocations = countAllocations() - allocations;
+
+	auto stats = filter.getStats();
+	printf("storm: %llu advertisements, matched %llu rejected %llu cached %llu unnamed %llu, logged %d suppressed %llu, %.1f ns/advertisement, %llu allocations\n",
+		(unsigned long long)stats.advertisements, (unsigned long long)stats.matched, (unsigned long long)stats.rejected,
+		(unsigned long long)stats.cached, (unsigned long long)stats.unnamed, logged, (unsigned long long)suppressedTotal,
+		(double)elapsed / stats.advertisements, (unsigned long long)allocations);
+
+	CHECK(found == STORM_TICKS);
+	CHECK(stats.matched == STORM_TICKS);
+	CHECK(allocations == 0);
+
+	// Named devices are only looked up once per cache expiry, 133 of them over 60 s
+	auto namedDevices = STORM_DEVICES - (STORM_DEVICES + 2) / 3;
+	CHECK(stats.rejected == (uint64_t)namedDevices);
+	CHECK(stats.cached == (uint64_t)namedDevices * (STORM_TICKS - 1));
+
+	// Every rejection is either logged or counted as suppressed, at most ADVERTISEMENT_LOG_PER_SECOND per second
+	CHECK(logged + suppressedTotal <= stats.rejected);
+	CHECK(logged <= ADVERTISEMENT_LOG_PER_SECOND * (STORM_TICKS / 10 + 1));
+}
+
+static void testExpiry() {
+	AdvertisementFilter filter;
+	bool isLogged;
+	uint64_t suppressed;
+
+	auto now = 1000000000ull;
+	filter.check(0x010203040506ull, L"Headphones", 10, now, isLogged, suppressed);
+	CHECK(isLogged);
+
+	// A device that gets renamed into a controller (firmware update, reset) is found again once the entry expires
+	now += ADVERTISEMENT_CACHE_EXPIRY_NS - 1;
+	CHECK(filter.check(0x010203040506ull, L"IIDX Entry model", 16, now, isLogged, suppressed) == DeviceType::UNKNOWN);
+	now += 1;
+	CHECK(filter.check(0x010203040506ull, L"IIDX Entry model", 16, now, isLogged, suppressed) == DeviceType::IIDX);
+
+	auto stats = filter.getStats();
+	CHECK(stats.rejected == 1 && stats.cached == 1 && stats.matched == 1);
+}
+
+static void testLogRateLimit() {
+	AdvertisementFilter filter;
+	bool isLogged;
+	uint64_t suppressed;
+
+	auto now = 1000000000ull;
+	auto logged = 0;
+	for (auto i = 0; i < 20; i++) {
+		filter.check(0xbb0000000000ull + i, L"Watch", 5, now, isLogged, suppressed);
+		logged += isLogged;
+		CHECK(suppressed == 0);
+	}
+	CHECK(logged == ADVERTISEMENT_LOG_PER_SECOND);
+
+	// The first message of the next second reports what was dropped
+	now += 1000000000ull;
+	filter.check(0xbc0000000000ull, L"Watch", 5, now, isLogged, suppressed);
+	CHECK(isLogged);
+	CHECK(suppressed == 20 - ADVERTISEMENT_LOG_PER_SECOND);
+}
+
+int main() {
+	testNames();
+	testStorm();
+	testExpiry();
+	testLogRateLimit();
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,43 @@
+#include <cstdlib>
+#include <new>
+
+#include "alloccount.h"
+
+// Global operator new is replaced so allocations made on the hot path can be counted. This only
+// happens in the benchmark and test binaries, the feeder itself keeps the standard allocator.
+static thread_local uint64_t allocationCount = 0;
+
+void *operator new(size_t size) {
+	allocationCount++;
+
+	auto ptr = malloc(size > 0 ? size : 1);
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+uint64_t countAllocations() {
+	return allocationCount;
+}
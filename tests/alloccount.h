@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Allocations made so far by the calling thread. Only available in binaries that link alloccount.cpp,
+// which replaces global operator new.
+uint64_t countAllocations();
@@ -0,0 +1,129 @@
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#include "axis.h"
+#include "check.h"
+#include "timing.h"
+
+// The axis tables have to match the per-packet formula the feeder used before them bit for bit, for
+// every input and a sweep of sensitivities, and be cheaper than evaluating it.
+
+#define AXIS_SWEEP_STEPS 1000 // Sensitivities from 0 to 10 in steps of 0.01
+#define AXIS_BENCHMARK_PACKETS 10000000
+
+// Straight from the old analog branch of the notification handler
+static long computeAxisValue(unsigned char data, double sensitivity) {
+	return (long)std::round((((double)data * sensitivity) / 255.0) * 32768.0) % 32768;
+}
+
+static int compareTable(const AxisConfig &config) {
+	AxisTable table;
+	buildAxisTable(table, config);
+
+	auto mismatches = 0;
+	for (auto data = 0; data < 256; data++) {
+		if (table.values[data] != computeAxisValue((unsigned char)data, config.sensitivity)) {
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+static void testLinearEquivalence() {
+	auto mismatches = 0;
+	auto tables = 0;
+
+	for (auto step = 0; step <= AXIS_SWEEP_STEPS; step++) {
+		AxisConfig config = { step / 100.0, 1.0, 0 };
+		mismatches += compareTable(config);
+		tables++;
+	}
+
+	// Values that don't land on a round step
+	const double sensitivities[] = { 0.333, 0.5, 1.0 / 3.0, 1.2345, 2.0 / 3.0, 3.14159, 7.777 };
+	for (auto sensitivity : sensitivities) {
+		AxisConfig config = { sensitivity, 1.0, 0 };
+		mismatches += compareTable(config);
+		tables++;
+	}
+
+	printf("linear: %d tables of 256 inputs, %d values differ from the formula\n", tables, mismatches);
+	CHECK(mismatches == 0);
+}
+
+static void testInvalidCurves() {
+	CHECK(!isValidAxisCurve(0.0));
+	CHECK(!isValidAxisCurve(-1.0));
+	CHECK(!isValidAxisCurve(std::numeric_limits<double>::quiet_NaN()));
+	CHECK(!isValidAxisCurve(std::numeric_limits<double>::infinity()));
+	CHECK(isValidAxisCurve(0.5));
+	CHECK(isValidAxisCurve(1.0));
+
+	// Never raise 0 to a negative power, these fall back to linear
+	const double curves[] = { 0.0, -0.5, -2.0, std::numeric_limits<double>::quiet_NaN() };
+	for (auto curve : curves) {
+		AxisConfig config = { 1.0, curve, 0 };
+		CHECK(compareTable(config) == 0);
+	}
+}
+
+static void testCurveAndDeadzone() {
+	const double curves[] = { 0.5, 1.0, 2.0, 3.0 };
+	const int deadzones[] = { 0, 1, 16, 100, 254, 300 };
+
+	for (auto curve : curves) {
+		for (auto deadzone : deadzones) {
+			AxisConfig config = { 1.0, curve, deadzone };
+			AxisTable table;
+			buildAxisTable(table, config);
+
+			auto clampedDeadzone = deadzone > 254 ? 254 : deadzone;
+			for (auto data = 0; data < 256; data++) {
+				CHECK(table.values[data] >= 0 && table.values[data] < 32768);
+
+				if (data <= clampedDeadzone) {
+					CHECK(table.values[data] == 0);
+				}
+				else if (data < 255) {
+					CHECK(table.values[data] >= table.values[data - 1]);
+				}
+			}
+
+			// Full deflection still reaches the same value as the linear table, which wraps around like the turntable does
+			CHECK(table.values[255] == computeAxisValue(255, 1.0));
+		}
+	}
+}
+
+static void benchmarkTable() {
+	AxisConfig config = { 1.5, 1.0, 0 };
+	AxisTable table;
+	buildAxisTable(table, config);
+
+	volatile int32_t sink = 0;
+
+	auto start = getTimestampNs();
+	for (uint32_t i = 0; i < AXIS_BENCHMARK_PACKETS; i++) {
+		sink = sink + computeAxisValue((unsigned char)(i * 7), config.sensitivity);
+	}
+	auto formulaNs = getTimestampNs() - start;
+
+	start = getTimestampNs();
+	for (uint32_t i = 0; i < AXIS_BENCHMARK_PACKETS; i++) {
+		sink = sink + table.values[(unsigned char)(i * 7)];
+	}
+	auto tableNs = getTimestampNs() - start;
+
+	printf("formula %.2f ns/value, table %.2f ns/value\n", (double)formulaNs / AXIS_BENCHMARK_PACKETS, (double)tableNs / AXIS_BENCHMARK_PACKETS);
+}
+
+int main() {
+	testLinearEquivalence();
+	testInvalidCurves();
+	testCurveAndDeadzone();
+	benchmarkTable();
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,62 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "alloccount.h"
+#include "benchmark.h"
+#include "logger.h"
+#include "motion.h"
+
+static std::wstring widen(const char *str) {
+	std::wstring ret(strlen(str), L'\0');
+	ret.resize(mbstowcs(&ret[0], str, ret.size()));
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	std::wstring capturePath;
+	std::wstring baselinePath;
+	std::wstring savePath;
+
+	BenchmarkOptions options = { nullptr, nullptr, nullptr, BENCHMARK_DEFAULT_THRESHOLD, BENCHMARK_DEFAULT_NOTIFICATIONS, countAllocations };
+
+	for (auto argIdx = 1; argIdx < argc; argIdx++) {
+		std::string arg = argv[argIdx];
+
+		if (arg == "--help") {
+			printf("usage: %s [--capture file] [--baseline file] [--save file] [--threshold 10] [--notifications 20000]\n", argv[0]);
+			return 0;
+		}
+		else if (arg == "--capture" && argIdx + 1 < argc) {
+			capturePath = widen(argv[++argIdx]);
+			options.capturePath = capturePath.c_str();
+		}
+		else if (arg == "--baseline" && argIdx + 1 < argc) {
+			baselinePath = widen(argv[++argIdx]);
+			options.baselinePath = baselinePath.c_str();
+		}
+		else if (arg == "--save" && argIdx + 1 < argc) {
+			savePath = widen(argv[++argIdx]);
+			options.savePath = savePath.c_str();
+		}
+		else if (arg == "--threshold" && argIdx + 1 < argc) {
+			options.threshold = atof(argv[++argIdx]);
+		}
+		else if (arg == "--notifications" && argIdx + 1 < argc) {
+			options.notifications = strtoul(argv[++argIdx], nullptr, 10);
+		}
+		else {
+			printf("Unknown argument! %s\n", arg.c_str());
+			return -1;
+		}
+	}
+
+	DecoderConfig config = { false, { { 1.0, 1.0, 0 }, { 1.0, 1.0, 0 } }, {}, { MOTION_DEFAULT_HYSTERESIS, MOTION_DEFAULT_HOLD_FRAMES, 0 }, nullptr, false };
+
+	startLogger(LOG_OFF, false);
+	auto ret = runBenchmark(options, config);
+	stopLogger();
+
+	return ret;
+}
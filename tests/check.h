@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal assertions for the test binaries, a failed check is printed and makes main return 1
+static int checkFailures = 0;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			checkFailures++; \
+		} \
+	} while (0)
+
+#define CHECK_RESULT() (checkFailures > 0 ? 1 : 0)
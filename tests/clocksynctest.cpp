@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "check.h"
+#include "clocksync.h"
+#include "controller.h"
+#include "logger.h"
+#include "testcontroller.h"
+#include "xorshift.h"
+
+// The frame clock has to recover when each packet was sampled from notifications that arrive in batches
+// with scheduling jitter, across counter wraparound, clock drift, drops and silences, and a controller
+// that connects again has to start over instead of continuing from its old connection.
+
+#define CLOCKSYNC_TEST_FRAMES 200000
+#define CLOCKSYNC_TEST_SETTLE_FRAMES 5000 // Not measured while the period estimate settles
+#define CLOCKSYNC_TEST_BASE_TIME 5000000000000ull
+
+struct LinkScenario {
+	const char *name;
+	double periodNs; // Nominal controller frame period
+	double driftPpm; // How much faster the controller clock runs than the host clock
+	double intervalNs; // Connection interval, everything sampled since the last event arrives together
+	double jitterMeanNs; // Mean of the exponential delay added to every notification
+	double dropRate;
+	int silenceAtFrame; // -1 for none
+	double silenceNs;
+	bool isCounterRestarted; // The controller restarts its counter after the silence instead of going on
+	double maxP99Us; // Limits checked for the reconstructed timestamps
+	double maxPeriodErrorPpm;
+};
+
+struct LinkResult {
+	double p50Us;
+	double p99Us;
+	double naiveP99Us;
+	double periodErrorPpm;
+	int backwardSteps;
+};
+
+static double nextUniform(uint32_t &state) {
+	return (nextRandom(state) + 0.5) / 4294967296.0;
+}
+
+static double getPercentile(std::vector<double> &values, double percentile) {
+	return values[(size_t)(percentile * (values.size() - 1))] / 1000.0;
+}
+
+static LinkResult runScenario(const LinkScenario &scenario) {
+	uint32_t random = 0x2545f491;
+	ClockSync sync;
+	resetClockSync(sync);
+
+	auto truePeriod = scenario.periodNs * (1.0 + scenario.driftPpm * 1e-6);
+	auto nextEvent = scenario.intervalNs * 0.37;
+
+	struct Sample {
+		uint8_t frame;
+		double time;
+	};
+	std::vector<Sample> pending;
+	std::vector<double> errors;
+	std::vector<double> naiveErrors;
+
+	LinkResult result = {};
+	uint64_t lastTimestamp = 0;
+
+	for (auto frame = 0; frame < CLOCKSYNC_TEST_FRAMES; frame++) {
+		auto isAfterSilence = scenario.silenceAtFrame >= 0 && frame > scenario.silenceAtFrame;
+		auto sampleTime = frame * truePeriod;
+		if (isAfterSilence && scenario.isCounterRestarted) {
+			sampleTime += scenario.silenceNs;
+		}
+
+		// Deliver every connection event up to this frame
+		while (sampleTime > nextEvent) {
+			if (!pending.empty()) {
+				auto arrival = nextEvent - scenario.jitterMeanNs * std::log(nextUniform(random));
+				for (auto &sample : pending) {
+					auto timestamp = updateClockSync(sync, sample.frame, CLOCKSYNC_TEST_BASE_TIME + (uint64_t)arrival);
+					if (timestamp < lastTimestamp) {
+						result.backwardSteps++;
+					}
+					lastTimestamp = timestamp;
+
+					if (frame > CLOCKSYNC_TEST_SETTLE_FRAMES) {
+						errors.push_back(std::fabs((double)(int64_t)(timestamp - CLOCKSYNC_TEST_BASE_TIME) - sample.time));
+						naiveErrors.push_back(arrival - sample.time);
+					}
+				}
+				pending.clear();
+			}
+			nextEvent += scenario.intervalNs;
+		}
+
+		auto isSilent = isAfterSilence && !scenario.isCounterRestarted && sampleTime < scenario.silenceAtFrame * truePeriod + scenario.silenceNs;
+		if (frame == scenario.silenceAtFrame || isSilent || nextUniform(random) < scenario.dropRate) {
+			continue;
+		}
+
+		auto counter = frame + (isAfterSilence && scenario.isCounterRestarted ? 77 : 0);
+		pending.push_back({ (uint8_t)counter, sampleTime });
+	}
+
+	std::sort(errors.begin(), errors.end());
+	std::sort(naiveErrors.begin(), naiveErrors.end());
+	result.p50Us = getPercentile(errors, 0.5);
+	result.p99Us = getPercentile(errors, 0.99);
+	result.naiveP99Us = getPercentile(naiveErrors, 0.99);
+	result.periodErrorPpm = std::fabs(getClockSyncPeriod(sync) / truePeriod - 1.0) * 1e6;
+	return result;
+}
+
+static void testLinkScenarios() {
+	const LinkScenario scenarios[] = {
+		{ "1ms frames, 7.5ms interval", 1000000, 0, 7500000, 300000, 0, -1, 0, false, 1000, 50 },
+		{ "1ms frames, +80ppm drift", 1000000, 80, 7500000, 300000, 0, -1, 0, false, 1000, 50 },
+		{ "1ms frames, -120ppm, 5% drops", 1000000, -120, 7500000, 300000, 0.05, -1, 0, false, 1000, 50 },
+		{ "4ms frames, 15ms interval, 2ms jitter", 4000000, 30, 15000000, 2000000, 0.01, -1, 0, false, 2500, 50 },
+		{ "1ms frames, 3s link outage", 1000000, 50, 7500000, 300000, 0, 100000, 3000000000.0, false, 1000, 50 },
+		{ "1ms frames, 3s off, counter restart", 1000000, 50, 7500000, 300000, 0, 100000, 3000000000.0, true, 1000, 50 },
+	};
+
+	for (auto &scenario : scenarios) {
+		auto result = runScenario(scenario);
+		printf("%-38s error p50 %6.1fus p99 %6.1fus (arrival time p99 %7.1fus), period off by %.1fppm\n",
+			scenario.name, result.p50Us, result.p99Us, result.naiveP99Us, result.periodErrorPpm);
+
+		CHECK(result.p99Us < scenario.maxP99Us);
+		CHECK(result.p99Us < result.naiveP99Us);
+		CHECK(result.periodErrorPpm < scenario.maxPeriodErrorPpm);
+		CHECK(result.backwardSteps == 0);
+	}
+}
+
+static void testWraparound() {
+	ClockSync sync;
+	resetClockSync(sync);
+
+	// Exact 1ms frames, one packet per notification, over many wraps of the 8-bit counter
+	auto isMonotonic = true;
+	uint64_t lastTimestamp = 0;
+	for (auto frame = 0; frame < 256 * 40; frame++) {
+		auto timestamp = updateClockSync(sync, (uint8_t)frame, CLOCKSYNC_TEST_BASE_TIME + frame * 1000000ull);
+		isMonotonic = isMonotonic && timestamp >= lastTimestamp;
+		lastTimestamp = timestamp;
+	}
+
+	CHECK(isMonotonic);
+	CHECK(sync.frameIndex == 256 * 40 - 1);
+	CHECK(std::fabs(getClockSyncPeriod(sync) - 1000000.0) < 1.0);
+
+	// A late packet from before the wrap is placed before the newest one, not 255 frames after it
+	auto late = updateClockSync(sync, (uint8_t)(256 * 40 - 3), lastTimestamp + 500000);
+	CHECK(sync.frameIndex == 256 * 40 - 1);
+	CHECK(late < lastTimestamp);
+
+	// 1000 frames of silence wrap the counter almost four times, the host clock tells how many
+	auto frame = 256 * 40 - 1 + 1000;
+	auto timestamp = updateClockSync(sync, (uint8_t)frame, CLOCKSYNC_TEST_BASE_TIME + frame * 1000000ull);
+	CHECK(sync.frameIndex == frame);
+	CHECK(timestamp == CLOCKSYNC_TEST_BASE_TIME + frame * 1000000ull);
+}
+
+static void testNotEnoughSamples() {
+	ClockSync sync;
+	resetClockSync(sync);
+
+	for (auto frame = 0; frame < CLOCKSYNC_MIN_SAMPLES - 1; frame++) {
+		auto arrival = CLOCKSYNC_TEST_BASE_TIME + frame * 1000000ull + (frame % 3) * 250000ull;
+		CHECK(updateClockSync(sync, (uint8_t)frame, arrival) == arrival);
+	}
+	CHECK(getClockSyncPeriod(sync) == 0.0);
+}
+
+// IIDX packet: turntable, unused, buttons low, buttons high, frame
+static void processPacket(Controller &controller, const DecoderConfig &config, uint8_t turntable, uint8_t frame, uint64_t arrival) {
+	unsigned char packet[5] = { turntable, 0, 0, 0, frame };
+	processNotification(controller, config, packet, sizeof(packet), arrival, arrival);
+}
+
+static void testReconnect() {
+	auto config = getDefaultDecoderConfig();
+	config.isDigital = true;
+
+	auto sink = new RecordingSink();
+	std::unique_ptr<Controller> controller(new Controller());
+	initTestController(*controller, DeviceType::IIDX, config, std::unique_ptr<OutputSink>(new CountingSink()));
+	setControllerOutput(*controller, std::unique_ptr<OutputSink>(sink), false, false);
+
+	// First connection, the turntable is spinning when the link drops
+	auto arrival = CLOCKSYNC_TEST_BASE_TIME;
+	for (auto frame = 0; frame < 300; frame++, arrival += 1000000) {
+		processPacket(*controller, config, (uint8_t)(frame * 2), (uint8_t)frame, arrival);
+	}
+	CHECK(sink->reports.back().axisX == MOTION_VALUE_POSITIVE);
+
+	// The controller comes back five seconds later with a counter and turntable that have nothing to do
+	// with the old ones
+	requestControllerReset(*controller);
+	arrival += 5000000000ull;
+	sink->reports.clear();
+	processPacket(*controller, config, 200, 17, arrival);
+	processPacket(*controller, config, 200, 18, arrival + 1000000);
+
+	auto snapshot = getMetricsSnapshot(controller->metrics);
+	CHECK(sink->reports.size() == 2);
+	CHECK(sink->reports[0].axisX == MOTION_VALUE_CENTER);
+	CHECK(sink->reports[0].timestamp == arrival);
+	CHECK(sink->reports[1].timestamp == arrival + 1000000);
+	CHECK(snapshot.droppedFrames == 0);
+	CHECK(snapshot.reorderedFrames == 0);
+	CHECK(getClockSyncPeriod(controller->clockSync) == 0.0);
+	CHECK(!controller->isResetPending.load());
+}
+
+int main() {
+	startLogger(LOG_OFF, false);
+
+	testLinkScenarios();
+	testWraparound();
+	testNotEnoughSamples();
+	testReconnect();
+
+	stopLogger();
+	return CHECK_RESULT();
+}
@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "controller.h"
+#include "logger.h"
+#include "pipeline.h"
+#include "testcontroller.h"
+#include "timing.h"
+#include "xorshift.h"
+
+// Several simulated controllers register themselves and stream notifications from their own threads
+// through ControllerRegistry and one NotificationPipeline, like BLE callbacks do. Every controller has
+// to end up with its own vJoy device and exactly the reports it would get if it was the only one.
+
+#define CONCURRENCY_CONTROLLERS 8
+#define CONCURRENCY_NOTIFICATIONS 20000
+#define CONCURRENCY_MAX_BURST 4
+#define CONCURRENCY_FRAME_NS 1000000ULL
+
+static const DeviceType controllerTypes[CONCURRENCY_CONTROLLERS] = {
+	DeviceType::IIDX, DeviceType::SDVX, DeviceType::POPN, DeviceType::GITADORA_GUITAR,
+	DeviceType::IIDX, DeviceType::SDVX, DeviceType::POPN, DeviceType::GITADORA_GUITAR,
+};
+
+static DecoderConfig config;
+
+struct SimulatedController {
+	uint64_t address;
+	DeviceType deviceType;
+	std::vector<unsigned char> data;
+	std::vector<size_t> lengths;
+	std::vector<uint64_t> arrivals;
+	Controller *controller;
+	RecordingSink *sink;
+};
+
+static void buildStream(SimulatedController &simulated, uint32_t seed) {
+	auto decoder = getPacketDecoder(simulated.deviceType, config);
+	uint32_t random = seed;
+	uint8_t frame = (uint8_t)seed;
+	uint64_t arrival = seed * 1000ULL;
+	uint8_t axis = 0;
+
+	for (size_t i = 0; i < CONCURRENCY_NOTIFICATIONS; i++) {
+		auto burst = 1 + nextRandom(random) % CONCURRENCY_MAX_BURST;
+		for (size_t packetIdx = 0; packetIdx < burst; packetIdx++) {
+			unsigned char packet[8] = {};
+			axis = (uint8_t)(axis + nextRandom(random) % 9 - 4);
+			packet[0] = axis;
+			packet[1] = (uint8_t)(nextRandom(random) % 4 == 0 ? nextRandom(random) : 0);
+			packet[2] = (uint8_t)(nextRandom(random) & 0x7f);
+			packet[3] = (uint8_t)(nextRandom(random) & 0x03);
+			packet[decoder.frameOffset] = frame++;
+			simulated.data.insert(simulated.data.end(), packet, packet + decoder.packetLen);
+		}
+
+		arrival += burst * CONCURRENCY_FRAME_NS;
+		simulated.lengths.push_back(burst * decoder.packetLen);
+		simulated.arrivals.push_back(arrival);
+	}
+}
+
+static void feedNotification(void *context, const unsigned char *data, size_t len, uint64_t arrival) {
+	processNotification(*(Controller*)context, config, data, len, arrival, getTimestampNs());
+}
+
+static void runController(ControllerRegistry &registry, const std::vector<DeviceMapping> &mappings, NotificationPipeline &pipeline, SimulatedController &simulated) {
+	auto controller = registry.addController(simulated.address, simulated.deviceType, config, mappings, 1);
+	CHECK(controller != nullptr);
+	if (controller == nullptr) {
+		return;
+	}
+
+	simulated.sink = new RecordingSink();
+	setControllerOutput(*controller, std::unique_ptr<OutputSink>(simulated.sink), true, false);
+	controller->queue = pipeline.addQueue(controller);
+	simulated.controller = controller;
+
+	size_t offset = 0;
+	for (size_t i = 0; i < simulated.lengths.size(); i++) {
+		size_t depth;
+		while (!pipeline.push(controller->queue, &simulated.data[offset], simulated.lengths[i], simulated.arrivals[i], depth)) {
+			std::this_thread::yield();
+		}
+		offset += simulated.lengths[i];
+	}
+}
+
+static bool isSameReport(const FeederReport &a, const FeederReport &b) {
+	return a.axisX == b.axisX && a.axisY == b.axisY && a.axisZ == b.axisZ && a.buttons == b.buttons && a.frame == b.frame && a.timestamp == b.timestamp;
+}
+
+static void runTest(WaitStrategy strategy) {
+	std::vector<SimulatedController> simulated(CONCURRENCY_CONTROLLERS);
+	for (size_t i = 0; i < CONCURRENCY_CONTROLLERS; i++) {
+		simulated[i].address = 0x001122334400ULL + i;
+		simulated[i].deviceType = controllerTypes[i];
+		simulated[i].controller = nullptr;
+		simulated[i].sink = nullptr;
+		buildStream(simulated[i], (uint32_t)(0x9e3779b9 * (i + 1)));
+	}
+
+	// The second IIDX gets a fixed device by address, whichever SDVX registers first by device type, everything else the next free one
+	std::vector<DeviceMapping> mappings;
+	mappings.push_back({ true, simulated[4].address, DeviceType::UNKNOWN, 12 });
+	mappings.push_back({ false, 0, DeviceType::SDVX, 10 });
+
+	ControllerRegistry registry;
+	NotificationPipeline pipeline(strategy, feedNotification);
+	pipeline.start();
+
+	std::vector<std::thread> threads;
+	for (auto &controller : simulated) {
+		threads.push_back(std::thread(runController, std::ref(registry), std::cref(mappings), std::ref(pipeline), std::ref(controller)));
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	pipeline.stop();
+
+	CHECK(registry.getControllerCount() == CONCURRENCY_CONTROLLERS);
+
+	auto mismatches = 0;
+	bool isVjoyDeviceUsed[MAX_VJOY_DEVICES + 1] = {};
+
+	for (auto &controller : simulated) {
+		if (controller.controller == nullptr) {
+			continue;
+		}
+
+		CHECK(registry.findController(controller.address) == controller.controller);
+		CHECK(controller.controller->vjoyDevId >= 1 && controller.controller->vjoyDevId <= MAX_VJOY_DEVICES);
+		CHECK(!isVjoyDeviceUsed[controller.controller->vjoyDevId]);
+		isVjoyDeviceUsed[controller.controller->vjoyDevId] = true;
+
+		// The same stream decoded on its own
+		auto referenceSink = new RecordingSink();
+		std::unique_ptr<Controller> reference(new Controller());
+		initTestController(*reference, controller.deviceType, config, std::unique_ptr<OutputSink>(referenceSink));
+
+		size_t offset = 0;
+		for (size_t i = 0; i < controller.lengths.size(); i++) {
+			processNotification(*reference, config, &controller.data[offset], controller.lengths[i], controller.arrivals[i], controller.arrivals[i]);
+			offset += controller.lengths[i];
+		}
+
+		auto &reports = controller.sink->reports;
+		CHECK(reports.size() == referenceSink->reports.size());
+		for (size_t i = 0; i < reports.size() && i < referenceSink->reports.size(); i++) {
+			if (!isSameReport(reports[i], referenceSink->reports[i])) {
+				mismatches++;
+			}
+		}
+
+		auto snapshot = getMetricsSnapshot(controller.controller->metrics);
+		CHECK(snapshot.notifications == CONCURRENCY_NOTIFICATIONS);
+		CHECK(snapshot.droppedFrames == 0 && snapshot.reorderedFrames == 0);
+	}
+
+	CHECK(simulated[4].controller == nullptr || simulated[4].controller->vjoyDevId == 12);
+	CHECK(isVjoyDeviceUsed[10]);
+	CHECK((simulated[1].controller != nullptr && simulated[1].controller->vjoyDevId == 10) || (simulated[5].controller != nullptr && simulated[5].controller->vjoyDevId == 10));
+
+	printf("%s: %d controllers, %d reports differ from decoding each controller alone\n", getWaitStrategyName(strategy), CONCURRENCY_CONTROLLERS, mismatches);
+	CHECK(mismatches == 0);
+}
+
+int main() {
+	startLogger(LOG_OFF, false);
+	config = getDefaultDecoderConfig();
+
+	runTest(WAIT_BLOCK);
+	runTest(WAIT_YIELD);
+
+	config.isDigital = true;
+	runTest(WAIT_SPIN);
+
+	stopLogger();
+	return CHECK_RESULT();
+}
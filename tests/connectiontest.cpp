@@ -0,0 +1,298 @@
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "check.h"
+#include "connection.h"
+
+// Runs the connection manager against a simulated Bluetooth stack on a virtual clock, so every
+// delay, timeout and time-to-first-report is exact.
+
+#define MS 1000000ULL
+#define CONNECTION_CACHE_PATH L"connectiontest.cache" // Removed again by main
+
+static const uint64_t controllerAddress = 0x112233445566ULL;
+
+// Completes every call after a delay, like the WinRT async operations do. The links it keeps follow
+// the same rules as BleTransport.
+class SimulatedTransport : public ConnectionTransport {
+public:
+	SimulatedTransport() : manager(nullptr), isOn(true), validateDelay(30 * MS), subscribeDelay(10 * MS), firstReportDelay(8 * MS), disconnectDelay(0), now(0), validates(0), disconnects(0), staleDevicesClosed(0) {
+	}
+
+	void validate(uint64_t address, DeviceType, uint32_t attempt) override {
+		validates++;
+		auto delay = validateDelay;
+		if (!slowValidations.empty()) {
+			delay = slowValidations.front();
+			slowValidations.erase(slowValidations.begin());
+		}
+
+		Event event = { now + delay, Event::VALIDATED, address, attempt, isOn };
+		events.push_back(event);
+	}
+
+	void subscribe(uint64_t address, DeviceType, uint32_t attempt) override {
+		Event subscribed = { now + subscribeDelay, Event::SUBSCRIBED, address, attempt, isOn };
+		events.push_back(subscribed);
+
+		if (isOn) {
+			Event firstReport = { now + subscribeDelay + firstReportDelay, Event::FIRST_REPORT, address, attempt, true };
+			events.push_back(firstReport);
+		}
+	}
+
+	void disconnect(uint64_t address, uint32_t attempt) override {
+		disconnects++;
+		if (disconnectDelay == 0) {
+			dropLink(address, attempt);
+			return;
+		}
+
+		Event event = { now + disconnectDelay, Event::DISCONNECTED, address, attempt, true };
+		events.push_back(event);
+	}
+
+	// The device that's currently held reports a disconnect
+	void loseLink(uint64_t address) {
+		auto link = links.find(address);
+		if (link != links.end()) {
+			manager->onLinkLost(address, link->second, now);
+		}
+	}
+
+	// Delivers everything due up to time
+	void advance(uint64_t time) {
+		for (;;) {
+			auto next = events.end();
+			for (auto event = events.begin(); event != events.end(); ++event) {
+				if (event->time <= time && (next == events.end() || event->time < next->time)) {
+					next = event;
+				}
+			}
+
+			if (next == events.end()) {
+				break;
+			}
+
+			auto event = *next;
+			events.erase(next);
+			now = event.time;
+
+			switch (event.type) {
+			case Event::VALIDATED:
+				if (event.isSuccess) {
+					if (!manager->isCurrentAttempt(event.address, event.attempt)) {
+						staleDevicesClosed++;
+						break;
+					}
+					links[event.address] = event.attempt;
+				}
+				manager->onValidated(event.address, event.attempt, event.isSuccess, now);
+				break;
+			case Event::SUBSCRIBED:
+				manager->onSubscribed(event.address, event.attempt, event.isSuccess, now);
+				break;
+			case Event::FIRST_REPORT:
+				manager->onFirstReport(event.address, event.attempt, now);
+				break;
+			case Event::DISCONNECTED:
+				dropLink(event.address, event.attempt);
+				break;
+			}
+		}
+
+		now = time;
+	}
+
+	ConnectionManager *manager;
+	bool isOn;
+	uint64_t validateDelay;
+	uint64_t subscribeDelay;
+	uint64_t firstReportDelay;
+	uint64_t disconnectDelay; // 0 to disconnect right away
+	std::vector<uint64_t> slowValidations; // Delays used for the next validations instead of validateDelay
+	uint64_t now;
+
+	int validates;
+	int disconnects;
+	int staleDevicesClosed;
+	std::map<uint64_t, uint32_t> links; // Address to the attempt that validated the device
+
+private:
+	void dropLink(uint64_t address, uint32_t attempt) {
+		auto link = links.find(address);
+		if (link != links.end() && link->second == attempt) {
+			links.erase(link);
+		}
+	}
+
+	struct Event {
+		uint64_t time;
+		enum { VALIDATED, SUBSCRIBED, FIRST_REPORT, DISCONNECTED } type;
+		uint64_t address;
+		uint32_t attempt;
+		bool isSuccess;
+	};
+
+	std::vector<Event> events;
+};
+
+static void run(ConnectionManager &manager, SimulatedTransport &transport, uint64_t duration) {
+	auto end = transport.now + duration;
+	while (transport.now < end) {
+		transport.advance(transport.now + MS);
+		manager.update(transport.now);
+	}
+}
+
+static ConnectionInfo getInfo(ConnectionManager &manager) {
+	ConnectionInfo info = {};
+	CHECK(manager.getConnectionInfo(controllerAddress, info));
+	return info;
+}
+
+static ConnectionConfig getTestConfig() {
+	ConnectionConfig config;
+	getDefaultConnectionConfig(config);
+	config.cachePath = CONNECTION_CACHE_PATH;
+	config.backoffMinNs = 20 * MS;
+	config.timeoutNs = 100 * MS;
+	config.directAttempts = 4;
+	return config;
+}
+
+static void testScanAndReconnect() {
+	SimulatedTransport transport;
+	ConnectionManager manager(&transport, getTestConfig());
+	transport.manager = &manager;
+
+	manager.start(transport.now);
+	CHECK(manager.getConnectionCount() == 0);
+
+	manager.onAdvertisement(controllerAddress, DeviceType::SDVX, transport.now);
+	manager.onAdvertisement(controllerAddress, DeviceType::SDVX, transport.now); // Already validating
+	run(manager, transport, 100 * MS);
+
+	auto info = getInfo(manager);
+	CHECK(info.state == CONNECTION_STREAMING);
+	CHECK(transport.validates == 1);
+	CHECK(info.timeToFirstReportNs == 48 * MS); // Validate, subscribe, first report
+	printf("scan: first report %.1f ms after connecting\n", info.timeToFirstReportNs / (double)MS);
+
+	// A lost link is retried on the next update without any backoff
+	transport.loseLink(controllerAddress);
+	CHECK(getInfo(manager).state == CONNECTION_BACKOFF);
+	run(manager, transport, 100 * MS);
+
+	info = getInfo(manager);
+	CHECK(info.state == CONNECTION_STREAMING);
+	CHECK(info.reconnects == 1);
+	CHECK(info.timeToFirstReportNs == 48 * MS);
+
+	// Switched off: immediate retry, then 20 and 40 ms of backoff, then it waits for an advertisement
+	transport.isOn = false;
+	transport.loseLink(controllerAddress);
+	run(manager, transport, 1000 * MS);
+
+	info = getInfo(manager);
+	CHECK(info.state == CONNECTION_SCANNING);
+	CHECK(transport.validates == 2 + 3);
+	CHECK(transport.links.empty());
+	printf("switched off: %s after %u attempts, %d disconnects\n", getConnectionStateName(info.state), info.attempts, transport.disconnects);
+
+	// Advertising while it still fails gets the full round of direct attempts and backoff again
+	auto validates = transport.validates;
+	manager.onAdvertisement(controllerAddress, DeviceType::SDVX, transport.now);
+	run(manager, transport, 1000 * MS);
+	CHECK(getInfo(manager).state == CONNECTION_SCANNING);
+	CHECK(transport.validates == validates + 4);
+
+	transport.isOn = true;
+	manager.onAdvertisement(controllerAddress, DeviceType::SDVX, transport.now);
+	run(manager, transport, 100 * MS);
+	CHECK(getInfo(manager).state == CONNECTION_STREAMING);
+}
+
+static void testStaleValidation() {
+	SimulatedTransport transport;
+	ConnectionManager manager(&transport, getTestConfig());
+	transport.manager = &manager;
+
+	// Service discovery of the first attempt hangs past the timeout, the retry goes through quickly
+	transport.slowValidations.push_back(150 * MS);
+	manager.onAdvertisement(controllerAddress, DeviceType::IIDX, transport.now);
+	run(manager, transport, 300 * MS);
+
+	auto info = getInfo(manager);
+	CHECK(info.state == CONNECTION_STREAMING);
+	CHECK(info.attempts == 2);
+	CHECK(transport.staleDevicesClosed == 1);
+	CHECK(transport.links.size() == 1 && transport.links[controllerAddress] == 2);
+
+	// A disconnect notice from the first attempt's device doesn't touch the working link
+	manager.onLinkLost(controllerAddress, 1, transport.now);
+	CHECK(getInfo(manager).state == CONNECTION_STREAMING);
+	CHECK(getInfo(manager).reconnects == 0);
+
+	printf("stale validation: %d late device closed, streaming on attempt %u\n", transport.staleDevicesClosed, info.attempts);
+}
+
+static void testLateDisconnect() {
+	SimulatedTransport transport;
+	ConnectionManager manager(&transport, getTestConfig());
+	transport.manager = &manager;
+
+	// The first attempt times out and its disconnect only goes through once the retry holds the device
+	transport.slowValidations.push_back(150 * MS);
+	transport.disconnectDelay = 60 * MS;
+	manager.onAdvertisement(controllerAddress, DeviceType::IIDX, transport.now);
+	run(manager, transport, 300 * MS);
+
+	CHECK(getInfo(manager).state == CONNECTION_STREAMING);
+	CHECK(getInfo(manager).attempts == 2);
+	CHECK(transport.disconnects == 1);
+	CHECK(transport.links.size() == 1 && transport.links[controllerAddress] == 2);
+}
+
+static void testCachedStart() {
+	SimulatedTransport transport;
+	ConnectionManager manager(&transport, getTestConfig());
+	transport.manager = &manager;
+
+	// Written by testStaleValidation once the controller was streaming
+	manager.start(transport.now);
+	CHECK(manager.getConnectionCount() == 1);
+	run(manager, transport, 100 * MS);
+
+	auto info = getInfo(manager);
+	CHECK(info.state == CONNECTION_STREAMING);
+	CHECK(info.deviceType == DeviceType::IIDX);
+	printf("cached: first report %.1f ms after start without an advertisement\n", info.timeToFirstReportNs / (double)MS);
+}
+
+static void testCacheFile() {
+	std::vector<KnownController> controllers;
+	controllers.push_back({ 0xaabbccddeeffULL, DeviceType::IIDX });
+	controllers.push_back({ 0x010203040506ULL, DeviceType::GITADORA_GUITAR });
+	CHECK(saveConnectionCache(CONNECTION_CACHE_PATH, controllers));
+
+	std::vector<KnownController> loaded;
+	CHECK(loadConnectionCache(CONNECTION_CACHE_PATH, loaded));
+	CHECK(loaded.size() == 2);
+	CHECK(loaded.size() == 2 && loaded[0].address == 0xaabbccddeeffULL && loaded[0].deviceType == DeviceType::IIDX);
+	CHECK(loaded.size() == 2 && loaded[1].address == 0x010203040506ULL && loaded[1].deviceType == DeviceType::GITADORA_GUITAR);
+}
+
+int main() {
+	remove("connectiontest.cache");
+
+	testScanAndReconnect();
+	testStaleValidation();
+	testLateDisconnect();
+	testCachedStart();
+	testCacheFile();
+
+	remove("connectiontest.cache");
+	return CHECK_RESULT();
+}
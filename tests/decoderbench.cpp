@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "alloccount.h"
+#include "check.h"
+#include "controller.h"
+#include "decoder.h"
+#include "logger.h"
+#include "output.h"
+#include "testcontroller.h"
+#include "timing.h"
+#include "xorshift.h"
+
+// Decodes notifications straight from the raw bytes for every device type, then checks that neither
+// the decoder nor the whole notification path allocates.
+
+#define DECODER_PACKETS 200000
+#define DECODER_BURST 4
+
+static const DeviceType deviceTypes[] = { DeviceType::IIDX, DeviceType::SDVX, DeviceType::POPN, DeviceType::GITADORA_GUITAR };
+
+static void runDecoder(DeviceType deviceType, const DecoderConfig &config, const char *mode) {
+	auto decoder = getPacketDecoder(deviceType, config);
+
+	std::vector<unsigned char> data(decoder.packetLen * DECODER_PACKETS);
+	uint32_t random = 0x12345678;
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = (uint8_t)nextRandom(random);
+	}
+
+	// Frame counters go up so the digital motion engine sees a realistic stream
+	for (size_t i = 0; i < DECODER_PACKETS; i++) {
+		data[i * decoder.packetLen + decoder.frameOffset] = (uint8_t)i;
+	}
+
+	DecoderState state;
+	resetDecoderState(state);
+	FeederReport report = {};
+
+	auto allocationsBefore = countAllocations();
+	auto start = getTimestampNs();
+
+	uint32_t buttons = 0;
+	for (size_t i = 0; i < DECODER_PACKETS; i++) {
+		decoder.decodePacket(&data[i * decoder.packetLen], start, config, state, report);
+		buttons ^= report.buttons; // Keeps the decoding from being optimized away
+	}
+
+	auto elapsed = getTimestampNs() - start;
+	auto decoderAllocations = countAllocations() - allocationsBefore;
+
+	// Same packets through the whole notification path, several packets per notification
+	std::unique_ptr<Controller> controller(new Controller());
+	initTestController(*controller, deviceType, config, std::unique_ptr<OutputSink>(new CountingSink()));
+
+	auto notificationLen = decoder.packetLen * DECODER_BURST;
+	allocationsBefore = countAllocations();
+	for (size_t i = 0; i + notificationLen <= data.size(); i += notificationLen) {
+		auto now = getTimestampNs();
+		processNotification(*controller, config, &data[i], notificationLen, now, now);
+	}
+	auto notificationAllocations = countAllocations() - allocationsBefore;
+
+	printf("%-16s %-8s %8.1f ns/packet, %llu allocations decoding, %llu allocations per %d notifications, checksum %x\n",
+		getDeviceTypeName(deviceType),
+		mode,
+		(double)elapsed / DECODER_PACKETS,
+		(unsigned long long)decoderAllocations,
+		(unsigned long long)notificationAllocations,
+		DECODER_PACKETS / DECODER_BURST,
+		buttons);
+
+	CHECK(decoderAllocations == 0);
+	CHECK(notificationAllocations == 0);
+}
+
+int main() {
+	startLogger(LOG_OFF, false);
+
+	auto analogConfig = getDefaultDecoderConfig();
+
+	DecoderConfig digitalConfig = analogConfig;
+	digitalConfig.isDigital = true;
+
+	for (auto deviceType : deviceTypes) {
+		runDecoder(deviceType, analogConfig, "analog");
+		runDecoder(deviceType, digitalConfig, "digital");
+	}
+
+	stopLogger();
+	return CHECK_RESULT();
+}
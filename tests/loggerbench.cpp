@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "alloccount.h"
+#include "check.h"
+#include "controller.h"
+#include "logger.h"
+#include "metrics.h"
+#include "output.h"
+#include "testcontroller.h"
+#include "timing.h"
+
+// Compares the time a notification takes to decode with raw packet logging off, asynchronous and
+// synchronous. The log goes to /dev/null with line buffering like a console, pass --console to write
+// it to the real terminal instead. Errors have to be printed at every log level, events only when enabled.
+
+#define LOGGER_NOTIFICATIONS 20000
+#define LOGGER_BURST 3
+
+struct LoggerCase {
+	const char *name;
+	LogLevel level;
+	bool isSynchronous;
+};
+
+static const LoggerCase loggerCases[] = {
+	{ "off", LOG_OFF, false },
+	{ "async", LOG_RAW, false },
+	{ "sync", LOG_RAW, true },
+};
+
+static void buildStream(std::vector<unsigned char> &data, size_t packetLen) {
+	data.assign(packetLen * LOGGER_BURST * LOGGER_NOTIFICATIONS, 0);
+
+	for (size_t i = 0; i < LOGGER_BURST * LOGGER_NOTIFICATIONS; i++) {
+		auto packet = &data[i * packetLen];
+		packet[0] = (uint8_t)(i * 3);
+		packet[2] = (uint8_t)((i / 16) & 0x7f);
+		packet[4] = (uint8_t)i;
+	}
+}
+
+static MetricsSnapshot runCase(const LoggerCase &loggerCase, const DecoderConfig &config, const std::vector<unsigned char> &data, uint64_t &allocations) {
+	std::unique_ptr<Controller> controller(new Controller());
+	initTestController(*controller, DeviceType::IIDX, config, std::unique_ptr<OutputSink>(new CountingSink()));
+
+	std::unique_ptr<ControllerMetrics> timing(new ControllerMetrics());
+	resetMetrics(*timing);
+
+	startLogger(loggerCase.level, loggerCase.isSynchronous);
+
+	auto notificationLen = controller->decoder.packetLen * LOGGER_BURST;
+	auto allocationsBefore = countAllocations();
+
+	for (size_t i = 0; i + notificationLen <= data.size(); i += notificationLen) {
+		auto start = getTimestampNs();
+		processNotification(*controller, config, &data[i], notificationLen, start, start);
+		recordLatency(*timing, getTimestampNs() - start);
+	}
+
+	allocations = countAllocations() - allocationsBefore;
+
+	stopLogger();
+	fflush(stdout);
+
+	return getMetricsSnapshot(*timing);
+}
+
+static int countLines(const char *path, const char *prefix) {
+	auto file = fopen(path, "r");
+	if (file == nullptr) {
+		return -1;
+	}
+
+	auto count = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		count += strncmp(line, prefix, strlen(prefix)) == 0 ? 1 : 0;
+	}
+
+	fclose(file);
+	return count;
+}
+
+static void testErrorsAtEveryLevel() {
+	const LogLevel levels[] = { LOG_OFF, LOG_EVENTS, LOG_RAW };
+	const char *path = "loggerbench_errors.txt";
+
+	fflush(stdout);
+	auto savedStdout = dup(fileno(stdout));
+	if (freopen(path, "w", stdout) == nullptr) {
+		CHECK(false);
+		return;
+	}
+
+	for (auto level : levels) {
+		for (auto isSynchronous : { false, true }) {
+			startLogger(level, isSynchronous);
+			logEvent("event %d\n", (int)level);
+			logError("error %d\n", (int)level);
+			stopLogger();
+		}
+	}
+
+	fflush(stdout);
+	dup2(savedStdout, fileno(stdout));
+	close(savedStdout);
+
+	auto errors = countLines(path, "error ");
+	auto events = countLines(path, "event ");
+	remove(path);
+
+	printf("errors printed %d of 6, events printed %d of 4\n", errors, events);
+	CHECK(errors == 6);
+	CHECK(events == 4);
+}
+
+int main(int argc, char **argv) {
+	auto isConsole = argc > 1 && strcmp(argv[1], "--console") == 0;
+
+	auto config = getDefaultDecoderConfig();
+
+	std::vector<unsigned char> data;
+	buildStream(data, getPacketDecoder(DeviceType::IIDX, config).packetLen);
+
+	MetricsSnapshot snapshots[sizeof(loggerCases) / sizeof(loggerCases[0])];
+	uint64_t allocations[sizeof(loggerCases) / sizeof(loggerCases[0])];
+
+	auto savedStdout = -1;
+	if (!isConsole) {
+		fflush(stdout);
+		savedStdout = dup(fileno(stdout));
+		if (freopen("/dev/null", "w", stdout) == nullptr) {
+			return 1;
+		}
+		setvbuf(stdout, nullptr, _IOLBF, BUFSIZ);
+	}
+
+	for (size_t i = 0; i < sizeof(loggerCases) / sizeof(loggerCases[0]); i++) {
+		snapshots[i] = runCase(loggerCases[i], config, data, allocations[i]);
+	}
+
+	if (savedStdout >= 0) {
+		dup2(savedStdout, fileno(stdout));
+		close(savedStdout);
+	}
+
+	printf("%-8s %10s %10s %10s %10s\n", "logging", "p50 ns", "p99 ns", "p99.9 ns", "allocs");
+	for (size_t i = 0; i < sizeof(loggerCases) / sizeof(loggerCases[0]); i++) {
+		printf("%-8s %10llu %10llu %10llu %10llu\n",
+			loggerCases[i].name,
+			(unsigned long long)snapshots[i].latencyP50,
+			(unsigned long long)snapshots[i].latencyP99,
+			(unsigned long long)snapshots[i].latencyP999,
+			(unsigned long long)allocations[i]);
+	}
+
+	// The input thread only copies a record into the ring
+	CHECK(allocations[0] == 0);
+	CHECK(allocations[1] == 0);
+
+	testErrorsAtEveryLevel();
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#include "check.h"
+#include "controller.h"
+#include "logger.h"
+#include "metrics.h"
+#include "testcontroller.h"
+#include "timing.h"
+
+// Latency has to cover the time a collapsed burst takes to reach the device in endBurst, and frame
+// counter gaps have to be counted correctly across the 8-bit wraparound.
+
+#define METRICS_DEVICE_DELAY_US 2000
+
+// Stands in for a slow UpdateVJD that only runs when the collapsed burst is flushed
+class SlowDeviceSink : public OutputSink {
+public:
+	bool submit(const FeederReport &) override {
+		std::this_thread::sleep_for(std::chrono::microseconds(METRICS_DEVICE_DELAY_US));
+		return true;
+	}
+};
+
+static void testBurstLatency() {
+	auto config = getDefaultDecoderConfig();
+
+	std::unique_ptr<Controller> controller(new Controller());
+	initTestController(*controller, DeviceType::POPN, config, std::unique_ptr<OutputSink>(new CountingSink()));
+	setControllerOutput(*controller, std::unique_ptr<OutputSink>(new SlowDeviceSink()), true, true);
+
+	// Three packets with the same buttons collapse into one report that's sent from endBurst
+	for (auto i = 0; i < 20; i++) {
+		unsigned char data[18] = {};
+		for (auto packetIdx = 0; packetIdx < 3; packetIdx++) {
+			data[packetIdx * 6] = (uint8_t)(i & 1);
+			data[packetIdx * 6 + 5] = (uint8_t)(i * 3 + packetIdx);
+		}
+
+		auto now = getTimestampNs();
+		processNotification(*controller, config, data, sizeof(data), now, now);
+	}
+
+	auto snapshot = getMetricsSnapshot(controller->metrics);
+	printf("collapsed bursts: %llu latency samples, p50 %lluns\n", (unsigned long long)snapshot.latencyCount, (unsigned long long)snapshot.latencyP50);
+
+	CHECK(controller->outputSink->forwarded == 20);
+	CHECK(snapshot.latencyCount == 20); // One per notification
+	CHECK(snapshot.latencyP50 >= METRICS_DEVICE_DELAY_US * 1000 * 15 / 16); // Histogram buckets are within ~6%
+}
+
+static void testFrameGaps() {
+	std::unique_ptr<ControllerMetrics> metrics(new ControllerMetrics());
+	resetMetrics(*metrics);
+
+	const uint8_t frames[] = { 250, 251, 253, 254, 254, 2, 1, 3, 4 };
+	for (auto frame : frames) {
+		recordFrame(*metrics, frame);
+	}
+
+	auto snapshot = getMetricsSnapshot(*metrics);
+	CHECK(snapshot.droppedFrames == 1 + 3 - 1); // 252, then 255, 0 and 1 across the wraparound, 1 arrives late
+	CHECK(snapshot.duplicateFrames == 1);
+	CHECK(snapshot.reorderedFrames == 1);
+
+	// A late frame from before the first one recorded was never counted as dropped
+	resetMetrics(*metrics);
+	recordFrame(*metrics, 10);
+	recordFrame(*metrics, 9);
+	snapshot = getMetricsSnapshot(*metrics);
+	CHECK(snapshot.droppedFrames == 0);
+	CHECK(snapshot.reorderedFrames == 1);
+}
+
+int main() {
+	startLogger(LOG_OFF, false);
+
+	testBurstLatency();
+	testFrameGaps();
+
+	stopLogger();
+	return CHECK_RESULT();
+}
@@ -0,0 +1,221 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "check.h"
+#include "decoder.h"
+#include "motion.h"
+
+// Drives synthetic turntable/knob traces through the digital mode decoder and through the algorithm
+// the feeder used before the motion engine, and compares how many controller frames each takes to
+// report a start, reversal or stop, plus how often the output is wrong once it settled.
+
+#define LEGACY_UPDATE_FRAME_DELTA 1
+
+// The old digital branch of the notification handler, global state and all
+struct LegacyMotion {
+	int lastUpdateFrame;
+	bool initAxis[2];
+	int lastRawValue[2];
+	int currentValue[2];
+};
+
+static void resetLegacyMotion(LegacyMotion &legacy) {
+	legacy.lastUpdateFrame = -1;
+	legacy.initAxis[0] = legacy.initAxis[1] = false;
+	legacy.lastRawValue[0] = legacy.lastRawValue[1] = 0;
+	legacy.currentValue[0] = legacy.currentValue[1] = 0;
+}
+
+static void updateLegacyMotion(LegacyMotion &legacy, const unsigned char *packet) {
+	auto frameOverflow = abs(legacy.lastUpdateFrame - packet[4]) > 200;
+	if (legacy.lastUpdateFrame == -1 || (packet[4] - legacy.lastUpdateFrame > LEGACY_UPDATE_FRAME_DELTA) || (frameOverflow && (packet[4] - legacy.lastUpdateFrame) < LEGACY_UPDATE_FRAME_DELTA)) {
+		for (auto axisIdx = 0; axisIdx <= AXIS_Y - AXIS_X; axisIdx++) {
+			if (!legacy.initAxis[axisIdx]) {
+				legacy.lastRawValue[axisIdx] = packet[axisIdx];
+				legacy.initAxis[axisIdx] = true;
+			}
+
+			auto newValue = packet[axisIdx];
+			auto underflow = abs(legacy.lastRawValue[axisIdx] - newValue) > 200;
+			auto nextValue = 0;
+
+			if (underflow) {
+				if (legacy.lastRawValue[axisIdx] - newValue < 0) {
+					nextValue = 0;
+				}
+				else if (legacy.lastRawValue[axisIdx] - newValue > 0) {
+					nextValue = 32768;
+				}
+				else {
+					nextValue = 32768 / 2;
+				}
+			}
+			else {
+				if (legacy.lastRawValue[axisIdx] - newValue > 0) {
+					nextValue = 0;
+				}
+				else if (legacy.lastRawValue[axisIdx] - newValue < 0) {
+					nextValue = 32768;
+				}
+				else {
+					nextValue = 32768 / 2;
+				}
+			}
+
+			legacy.lastRawValue[axisIdx] = newValue;
+			legacy.currentValue[axisIdx] = nextValue;
+			legacy.lastUpdateFrame = packet[4];
+		}
+	}
+}
+
+// A stretch of a trace where both knobs turn at a constant speed, moving every period frames
+struct MotionSegment {
+	int frames;
+	int velocity[2];
+	int period;
+};
+
+struct MotionTrace {
+	const char *name;
+	uint8_t startRaw;
+	uint8_t startFrame;
+	std::vector<MotionSegment> segments;
+};
+
+struct MotionResult {
+	int latency; // Frames from the start of each segment until the output shows its direction, summed
+	int worstLatency;
+	int missed; // Segments whose direction was never reported
+	int glitches; // Frames with the wrong output after the direction was reported
+};
+
+static int getExpectedValue(int velocity) {
+	return velocity > 0 ? MOTION_VALUE_POSITIVE : velocity < 0 ? MOTION_VALUE_NEGATIVE : MOTION_VALUE_CENTER;
+}
+
+static void addFrame(MotionResult &result, int output, int expected, int frameIdx, bool &isReached) {
+	if (!isReached) {
+		if (output == expected) {
+			isReached = true;
+			result.latency += frameIdx;
+			result.worstLatency = frameIdx > result.worstLatency ? frameIdx : result.worstLatency;
+		}
+	}
+	else if (output != expected) {
+		result.glitches++;
+	}
+}
+
+static void runTrace(const MotionTrace &trace, const MotionConfig &motionConfig, MotionResult &engine, MotionResult &legacy) {
+	DecoderConfig config = { true, { { 1.0, 1.0, 0 }, { 1.0, 1.0, 0 } }, {}, motionConfig, nullptr, false };
+	buildDecoderTables(config);
+	auto decoder = getPacketDecoder(DeviceType::SDVX, config);
+
+	DecoderState state;
+	resetDecoderState(state);
+
+	LegacyMotion legacyMotion;
+	resetLegacyMotion(legacyMotion);
+
+	engine = MotionResult();
+	legacy = MotionResult();
+
+	uint8_t raw[2] = { trace.startRaw, (uint8_t)(trace.startRaw + 128) };
+	uint8_t frame = trace.startFrame;
+
+	// The first segment only settles the initial position
+	for (size_t segmentIdx = 0; segmentIdx < trace.segments.size(); segmentIdx++) {
+		auto &segment = trace.segments[segmentIdx];
+		bool isEngineReached[2] = { false, false };
+		bool isLegacyReached[2] = { false, false };
+
+		for (auto frameIdx = 0; frameIdx < segment.frames; frameIdx++) {
+			auto isMoving = (frameIdx + 1) % segment.period == 0;
+			for (auto axisIdx = 0; axisIdx < 2; axisIdx++) {
+				raw[axisIdx] = (uint8_t)(raw[axisIdx] + (isMoving ? segment.velocity[axisIdx] : 0));
+			}
+
+			unsigned char packet[5] = { raw[0], raw[1], 0, 0, frame++ };
+
+			FeederReport report;
+			decoder.decodePacket(packet, 0, config, state, report);
+			updateLegacyMotion(legacyMotion, packet);
+
+			if (segmentIdx == 0) {
+				continue;
+			}
+
+			int engineOutput[2] = { report.axisX, report.axisY };
+			for (auto axisIdx = 0; axisIdx < 2; axisIdx++) {
+				auto expected = getExpectedValue(segment.velocity[axisIdx]);
+				addFrame(engine, engineOutput[axisIdx], expected, frameIdx, isEngineReached[axisIdx]);
+				addFrame(legacy, legacyMotion.currentValue[axisIdx], expected, frameIdx, isLegacyReached[axisIdx]);
+			}
+		}
+
+		if (segmentIdx > 0) {
+			for (auto axisIdx = 0; axisIdx < 2; axisIdx++) {
+				engine.missed += isEngineReached[axisIdx] ? 0 : 1;
+				legacy.missed += isLegacyReached[axisIdx] ? 0 : 1;
+			}
+		}
+	}
+}
+
+static std::vector<MotionTrace> buildTraces() {
+	std::vector<MotionTrace> traces;
+
+	traces.push_back({ "start", 10, 0, { { 10, { 0, 0 }, 1 }, { 40, { 3, -3 }, 1 } } });
+	traces.push_back({ "reverse", 10, 0, { { 10, { 0, 0 }, 1 }, { 20, { 3, -2 }, 1 }, { 20, { -3, 2 }, 1 }, { 20, { 2, -4 }, 1 }, { 20, { -1, 1 }, 1 } } });
+	traces.push_back({ "stop", 10, 0, { { 10, { 0, 0 }, 1 }, { 20, { 3, 3 }, 1 }, { 20, { 0, 0 }, 1 }, { 20, { -3, -3 }, 1 }, { 20, { 0, 0 }, 1 } } });
+	traces.push_back({ "wraparound", 240, 200, { { 10, { 0, 0 }, 1 }, { 300, { 5, -5 }, 1 }, { 300, { -7, 7 }, 1 } } });
+	traces.push_back({ "fast", 0, 0, { { 10, { 0, 0 }, 1 }, { 100, { 60, -60 }, 1 }, { 100, { -90, 90 }, 1 } } });
+	traces.push_back({ "scratch", 100, 50, { { 10, { 0, 0 }, 1 }, { 3, { 4, 0 }, 1 }, { 3, { -4, 0 }, 1 }, { 3, { 4, 0 }, 1 }, { 3, { -4, 0 }, 1 }, { 3, { 4, 0 }, 1 }, { 3, { -4, 0 }, 1 } } });
+	traces.push_back({ "slow", 0, 0, { { 10, { 0, 0 }, 1 }, { 60, { 1, -1 }, 2 } } });
+	traces.push_back({ "knobs", 0, 0, { { 10, { 0, 0 }, 1 }, { 20, { 2, 0 }, 1 }, { 20, { 0, -2 }, 1 }, { 20, { -2, 2 }, 1 } } });
+
+	return traces;
+}
+
+int main() {
+	MotionConfig defaultConfig = { MOTION_DEFAULT_HYSTERESIS, MOTION_DEFAULT_HOLD_FRAMES, 0 };
+	MotionConfig instantConfig = { 1, 1, 0 }; // Releases as soon as a frame has no movement, like the old algorithm could at best
+
+	auto traces = buildTraces();
+
+	printf("%-12s %-24s %-24s %s\n", "trace", "engine latency/worst", "legacy latency/worst", "engine/legacy missed, glitches");
+
+	for (auto &trace : traces) {
+		MotionResult engine;
+		MotionResult legacy;
+		runTrace(trace, defaultConfig, engine, legacy);
+
+		MotionResult instantEngine;
+		MotionResult unused;
+		runTrace(trace, instantConfig, instantEngine, unused);
+
+		printf("%-12s %10d/%-13d %10d/%-13d %d/%d, %d/%d\n", trace.name, engine.latency, engine.worstLatency, legacy.latency, legacy.worstLatency, engine.missed, legacy.missed, engine.glitches, legacy.glitches);
+
+		// The engine never misses a direction and never reports a wrong one once it got there
+		CHECK(engine.missed == 0);
+		CHECK(engine.glitches == 0);
+
+		// Starts and reversals show up on the packet they happen in, stops after the hold time
+		CHECK(engine.worstLatency <= MOTION_DEFAULT_HOLD_FRAMES - 1);
+
+		// Without a hold time it is never slower than the old algorithm
+		CHECK(instantEngine.latency <= legacy.latency);
+	}
+
+	// Scratches and reversals have to be instant with the default settings, the old algorithm only
+	// looked every other frame
+	MotionResult engine;
+	MotionResult legacy;
+	runTrace(traces[5], defaultConfig, engine, legacy);
+	CHECK(engine.latency == 0);
+	CHECK(legacy.latency > 0);
+
+	return CHECK_RESULT();
+}
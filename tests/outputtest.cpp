@@ -0,0 +1,135 @@
+#include <cstdio>
+#include <vector>
+
+#include "check.h"
+#include "output.h"
+#include "testcontroller.h"
+#include "xorshift.h"
+
+// Collapsing a burst into its final state must never hide a button press or release that happened
+// inside it, whichever order they come in, and must still drop everything else.
+
+#define OUTPUT_TEST_BURSTS 20000
+#define OUTPUT_TEST_MAX_BURST 8
+#define OUTPUT_TEST_BUTTONS 4
+
+static FeederReport makeReport(uint32_t buttons, int32_t axisX) {
+	FeederReport report = {};
+	report.buttons = buttons;
+	report.axisX = axisX;
+	return report;
+}
+
+static void submitBurst(CoalescingSink &sink, const std::vector<FeederReport> &burst) {
+	sink.beginBurst();
+	for (auto &report : burst) {
+		sink.submit(report);
+	}
+	sink.endBurst();
+}
+
+static void testEdgesInOneBurst() {
+	RecordingSink recorder;
+	CoalescingSink sink(&recorder, true, true);
+
+	// Button 2 is held going in. Button 1 goes down and up again, button 2 goes up and down again.
+	submitBurst(sink, { makeReport(0x2, 0) });
+	submitBurst(sink, { makeReport(0x3, 1), makeReport(0x2, 2), makeReport(0x0, 3), makeReport(0x2, 4) });
+
+	CHECK(recorder.reports.size() == 4);
+	CHECK(recorder.reports[1].buttons == 0x3); // Button 1 pressed
+	CHECK(recorder.reports[2].buttons == 0x0); // Button 1 and 2 released
+	CHECK(recorder.reports[3].buttons == 0x2); // Button 2 pressed again
+	CHECK(recorder.reports[3].axisX == 4);
+	CHECK(sink.submitted == 5);
+	CHECK(sink.forwarded == 4);
+}
+
+static void testReleaseThenPress() {
+	RecordingSink recorder;
+	CoalescingSink sink(&recorder, true, true);
+
+	submitBurst(sink, { makeReport(0x1, 0) });
+	submitBurst(sink, { makeReport(0x0, 0), makeReport(0x1, 0) });
+
+	CHECK(recorder.reports.size() == 3);
+	CHECK(recorder.reports[1].buttons == 0x0);
+	CHECK(recorder.reports[2].buttons == 0x1);
+}
+
+static void testAxisOnlyBurst() {
+	RecordingSink recorder;
+	CoalescingSink sink(&recorder, true, true);
+
+	submitBurst(sink, { makeReport(0x1, 1), makeReport(0x1, 2), makeReport(0x1, 3), makeReport(0x1, 4) });
+	submitBurst(sink, { makeReport(0x1, 4), makeReport(0x1, 4) });
+
+	CHECK(recorder.reports.size() == 1);
+	CHECK(recorder.reports[0].axisX == 4);
+}
+
+// Which buttons went down and which went up anywhere in a sequence of reports
+static void getEdges(uint32_t previous, const FeederReport *reports, size_t count, uint32_t &pressed, uint32_t &released) {
+	pressed = 0;
+	released = 0;
+	for (size_t i = 0; i < count; i++) {
+		pressed |= reports[i].buttons & ~previous;
+		released |= previous & ~reports[i].buttons;
+		previous = reports[i].buttons;
+	}
+}
+
+static void testRandomBursts(bool isSuppressingDuplicates) {
+	RecordingSink recorder;
+	CoalescingSink sink(&recorder, isSuppressingDuplicates, true);
+
+	uint32_t random = 0x13572468;
+	uint32_t buttons = 0;
+	auto lostEdges = 0;
+	auto wrongStates = 0;
+	std::vector<FeederReport> burst;
+
+	for (auto burstIdx = 0; burstIdx < OUTPUT_TEST_BURSTS; burstIdx++) {
+		auto previous = buttons;
+		auto sent = recorder.reports.size();
+
+		burst.clear();
+		auto length = 1 + nextRandom(random) % OUTPUT_TEST_MAX_BURST;
+		for (uint32_t i = 0; i < length; i++) {
+			if (nextRandom(random) % 3 == 0) {
+				buttons ^= 1u << (nextRandom(random) % OUTPUT_TEST_BUTTONS);
+			}
+			burst.push_back(makeReport(buttons, (int32_t)(nextRandom(random) % 5)));
+		}
+		submitBurst(sink, burst);
+
+		uint32_t inPressed, inReleased, outPressed, outReleased;
+		getEdges(previous, burst.data(), burst.size(), inPressed, inReleased);
+		getEdges(previous, recorder.reports.data() + sent, recorder.reports.size() - sent, outPressed, outReleased);
+
+		if ((inPressed & ~outPressed) != 0 || (inReleased & ~outReleased) != 0) {
+			lostEdges++;
+		}
+		if (!recorder.reports.empty() && recorder.reports.back().buttons != buttons) {
+			wrongStates++;
+		}
+	}
+
+	printf("random bursts%s: %llu reports submitted, %llu forwarded\n", isSuppressingDuplicates ? "" : " without suppression",
+		(unsigned long long)sink.submitted, (unsigned long long)sink.forwarded);
+
+	CHECK(lostEdges == 0);
+	CHECK(wrongStates == 0);
+	CHECK(sink.forwarded == recorder.reports.size());
+	CHECK(sink.forwarded < sink.submitted);
+}
+
+int main() {
+	testEdgesInOneBurst();
+	testReleaseThenPress();
+	testAxisOnlyBurst();
+	testRandomBursts(true);
+	testRandomBursts(false);
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "check.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "timing.h"
+
+// Measures how long a notification takes from NotificationPipeline::push until the feeder thread's
+// handler sees it, for every wait strategy, with notifications paced like a controller sends them and
+// back to back. Every notification carries a sequence number, so loss and reordering are caught too.
+
+#define PIPELINE_PACED_NOTIFICATIONS 5000
+#define PIPELINE_PACED_INTERVAL_US 100
+#define PIPELINE_FLOOD_NOTIFICATIONS 200000 // Spinning on a machine with one core costs a time slice per full ring, keep this short
+#define PIPELINE_NOTIFICATION_LEN 20
+
+struct HandoffContext {
+	std::unique_ptr<ControllerMetrics> latency;
+	uint32_t nextSequence;
+	uint64_t received;
+	uint64_t outOfOrder;
+};
+
+static void handleNotification(void *context, const unsigned char *data, size_t len, uint64_t arrival) {
+	auto now = getTimestampNs();
+	auto handoff = (HandoffContext*)context;
+
+	uint32_t sequence;
+	memcpy(&sequence, data, sizeof(sequence));
+
+	if (sequence != handoff->nextSequence || len != PIPELINE_NOTIFICATION_LEN) {
+		handoff->outOfOrder++;
+	}
+
+	handoff->nextSequence = sequence + 1;
+	handoff->received++;
+	recordLatency(*handoff->latency, now - arrival);
+}
+
+static void pushNotification(NotificationPipeline &pipeline, NotificationQueue *queue, uint32_t sequence, uint64_t &overflows) {
+	unsigned char data[PIPELINE_NOTIFICATION_LEN] = {};
+	memcpy(data, &sequence, sizeof(sequence));
+
+	size_t depth;
+	while (!pipeline.push(queue, data, sizeof(data), getTimestampNs(), depth)) {
+		overflows++;
+		std::this_thread::yield();
+	}
+}
+
+static void runStrategy(WaitStrategy strategy) {
+	HandoffContext paced = { std::unique_ptr<ControllerMetrics>(new ControllerMetrics()), 0, 0, 0 };
+	HandoffContext flood = { std::unique_ptr<ControllerMetrics>(new ControllerMetrics()), 0, 0, 0 };
+	resetMetrics(*paced.latency);
+	resetMetrics(*flood.latency);
+
+	NotificationPipeline pipeline(strategy, handleNotification);
+	auto pacedQueue = pipeline.addQueue(&paced);
+	auto floodQueue = pipeline.addQueue(&flood);
+	pipeline.start();
+
+	uint64_t pacedOverflows = 0;
+	for (uint32_t i = 0; i < PIPELINE_PACED_NOTIFICATIONS; i++) {
+		std::this_thread::sleep_for(std::chrono::microseconds(PIPELINE_PACED_INTERVAL_US));
+		pushNotification(pipeline, pacedQueue, i, pacedOverflows);
+	}
+
+	uint64_t floodOverflows = 0;
+	auto start = getTimestampNs();
+	for (uint32_t i = 0; i < PIPELINE_FLOOD_NOTIFICATIONS; i++) {
+		pushNotification(pipeline, floodQueue, i, floodOverflows);
+	}
+
+	// stop drains whatever is still queued
+	pipeline.stop();
+	auto elapsed = getTimestampNs() - start;
+
+	auto pacedSnapshot = getMetricsSnapshot(*paced.latency);
+	auto floodSnapshot = getMetricsSnapshot(*flood.latency);
+
+	printf("%-5s paced: p50 %7.2fus p99 %8.2fus max %9.2fus | back to back: %5.1fM/sec p50 %7.2fus, producer waited %llu times\n",
+		getWaitStrategyName(strategy),
+		pacedSnapshot.latencyP50 / 1000.0,
+		pacedSnapshot.latencyP99 / 1000.0,
+		pacedSnapshot.latencyMax / 1000.0,
+		PIPELINE_FLOOD_NOTIFICATIONS / (elapsed / 1000.0),
+		floodSnapshot.latencyP50 / 1000.0,
+		(unsigned long long)floodOverflows);
+
+	CHECK(paced.received == PIPELINE_PACED_NOTIFICATIONS);
+	CHECK(paced.outOfOrder == 0);
+	CHECK(pacedOverflows == 0);
+	CHECK(flood.received == PIPELINE_FLOOD_NOTIFICATIONS);
+	CHECK(flood.outOfOrder == 0);
+}
+
+// The ring on its own, one producer and one consumer thread and nothing else
+static void testQueue() {
+	std::unique_ptr<NotificationQueue> queue(new NotificationQueue(nullptr));
+	uint64_t mismatches = 0;
+
+	std::thread consumer([&queue, &mismatches]() {
+		for (uint32_t expected = 0; expected < PIPELINE_FLOOD_NOTIFICATIONS;) {
+			auto slot = queue->peek();
+			if (slot == nullptr) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			uint32_t sequence;
+			memcpy(&sequence, slot->data, sizeof(sequence));
+			if (sequence != expected || slot->arrival != sequence || slot->len != PIPELINE_NOTIFICATION_LEN) {
+				mismatches++;
+			}
+
+			queue->pop();
+			expected++;
+		}
+	});
+
+	for (uint32_t i = 0; i < PIPELINE_FLOOD_NOTIFICATIONS; i++) {
+		unsigned char data[PIPELINE_NOTIFICATION_LEN] = {};
+		memcpy(data, &i, sizeof(i));
+
+		size_t depth;
+		while (!queue->push(data, sizeof(data), i, depth)) {
+			std::this_thread::yield();
+		}
+		CHECK(depth <= PIPELINE_QUEUE_SLOTS);
+	}
+
+	consumer.join();
+	CHECK(mismatches == 0);
+	CHECK(queue->peek() == nullptr);
+}
+
+int main() {
+	testQueue();
+
+	runStrategy(WAIT_SPIN);
+	runStrategy(WAIT_YIELD);
+	runStrategy(WAIT_BLOCK);
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,361 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "check.h"
+#include "fileio.h"
+#include "remap.h"
+#include "timing.h"
+#include "xorshift.h"
+
+// The compiled tables have to give exactly what evaluating every rule one by one gives, for random
+// profiles and inputs, at a cost per packet that doesn't depend on the number of rules.
+
+#define REMAP_TEST_PROFILES 2000
+#define REMAP_TEST_MAX_RULES 40
+#define REMAP_TEST_INPUTS 200
+#define REMAP_BENCHMARK_REPORTS 4096
+#define REMAP_BENCHMARK_PASSES 5
+
+static bool isKnobDevice(DeviceType deviceType) {
+	return deviceType == DeviceType::IIDX || deviceType == DeviceType::SDVX;
+}
+
+// Straightforward interpretation of the profile format, evaluated for every report
+static void interpretRules(const std::vector<RemapRule> &rules, DeviceType deviceType, const DecoderState &state, FeederReport &report) {
+	auto shift = isKnobDevice(deviceType) ? 7 : 0;
+	int32_t axes[REMAP_AXES] = { report.axisX, report.axisY, report.axisZ };
+
+	int axisBytes[REMAP_AXES];
+	for (auto axis = 0; axis < REMAP_AXES; axis++) {
+		auto value = axes[axis] >> shift;
+		axisBytes[axis] = value < 0 ? 0 : value > 255 ? 255 : value;
+	}
+
+	bool motion[4] = {
+		state.motion[0].direction < 0, state.motion[0].direction > 0,
+		state.motion[1].direction < 0, state.motion[1].direction > 0,
+	};
+
+	bool isButtonMapped[REMAP_INPUT_BUTTONS] = {};
+	bool isAxisRouted[REMAP_AXES] = {};
+	bool isAxisPushed[REMAP_AXES] = {};
+	int axisRoute[REMAP_AXES] = { -1, -1, -1 };
+	int offsets[REMAP_AXES] = {};
+	uint32_t buttons = 0;
+
+	for (auto &rule : rules) {
+		if (rule.deviceType != DeviceType::UNKNOWN && rule.deviceType != deviceType) {
+			continue;
+		}
+
+		auto isActive = false;
+		switch (rule.input) {
+		case REMAP_FROM_BUTTON:
+			isButtonMapped[rule.inputIdx] = true;
+			isActive = ((report.buttons >> rule.inputIdx) & 1) != 0;
+			break;
+		case REMAP_FROM_AXIS_BELOW:
+			isActive = axisBytes[rule.inputIdx] < rule.threshold;
+			break;
+		case REMAP_FROM_AXIS_ABOVE:
+			isActive = axisBytes[rule.inputIdx] > rule.threshold;
+			break;
+		case REMAP_FROM_AXIS:
+			isAxisRouted[rule.inputIdx] = true;
+			if (rule.output == REMAP_TO_AXIS) {
+				axisRoute[rule.outputIdx] = rule.inputIdx;
+			}
+			break;
+		case REMAP_FROM_MOTION:
+			isActive = motion[rule.inputIdx];
+			break;
+		}
+
+		if (!isActive) {
+			continue;
+		}
+
+		if (rule.output == REMAP_TO_BUTTON) {
+			buttons |= 1u << rule.outputIdx;
+		}
+		else if (rule.output == REMAP_TO_AXIS_NEGATIVE || rule.output == REMAP_TO_AXIS_POSITIVE) {
+			offsets[rule.outputIdx] += rule.output == REMAP_TO_AXIS_NEGATIVE ? -MOTION_VALUE_CENTER : MOTION_VALUE_CENTER;
+			isAxisPushed[rule.outputIdx] = true;
+		}
+	}
+
+	for (auto button = 0; button < REMAP_INPUT_BUTTONS; button++) {
+		if (!isButtonMapped[button] && ((report.buttons >> button) & 1) != 0) {
+			buttons |= 1u << button;
+		}
+	}
+
+	// A pushed axis is centered plus the pushes, anything else shows its input, the axis routed to it, or
+	// the center if it was routed away
+	int32_t values[REMAP_AXES];
+	for (auto axis = 0; axis < REMAP_AXES; axis++) {
+		auto source = axisRoute[axis] >= 0 ? axisRoute[axis] : isAxisRouted[axis] ? -1 : axis;
+		if (!isAxisPushed[axis] && source >= 0) {
+			values[axis] = axes[source];
+		}
+		else {
+			auto value = MOTION_VALUE_CENTER + offsets[axis];
+			values[axis] = value < MOTION_VALUE_NEGATIVE ? MOTION_VALUE_NEGATIVE : value > MOTION_VALUE_POSITIVE ? MOTION_VALUE_POSITIVE : value;
+		}
+	}
+
+	report.axisX = values[0];
+	report.axisY = values[1];
+	report.axisZ = values[2];
+	report.buttons = buttons;
+}
+
+static RemapRule getRandomRule(uint32_t &random) {
+	RemapRule rule = {};
+	rule.deviceType = (DeviceType)(nextRandom(random) % REMAP_DEVICE_TYPES);
+
+	switch (nextRandom(random) % 5) {
+	case 0:
+		rule.input = REMAP_FROM_BUTTON;
+		rule.inputIdx = nextRandom(random) % REMAP_INPUT_BUTTONS;
+		break;
+	case 1:
+	case 2:
+		rule.input = nextRandom(random) % 2 ? REMAP_FROM_AXIS_BELOW : REMAP_FROM_AXIS_ABOVE;
+		rule.inputIdx = nextRandom(random) % REMAP_AXES;
+		rule.threshold = nextRandom(random) % 256;
+		break;
+	case 3:
+		rule.input = REMAP_FROM_AXIS;
+		rule.inputIdx = nextRandom(random) % REMAP_AXES;
+		rule.output = nextRandom(random) % 4 ? REMAP_TO_AXIS : REMAP_TO_NONE;
+		rule.outputIdx = nextRandom(random) % REMAP_AXES;
+		return rule;
+	default:
+		rule.input = REMAP_FROM_MOTION;
+		rule.inputIdx = nextRandom(random) % 4;
+		break;
+	}
+
+	switch (nextRandom(random) % 4) {
+	case 0:
+	case 1:
+		rule.output = REMAP_TO_BUTTON;
+		rule.outputIdx = nextRandom(random) % REMAP_OUTPUT_BUTTONS;
+		break;
+	case 2:
+		rule.output = REMAP_TO_AXIS_NEGATIVE;
+		rule.outputIdx = nextRandom(random) % REMAP_AXES;
+		break;
+	default:
+		rule.output = REMAP_TO_AXIS_POSITIVE;
+		rule.outputIdx = nextRandom(random) % REMAP_AXES;
+		break;
+	}
+
+	return rule;
+}
+
+static void getRandomInput(uint32_t &random, DeviceType deviceType, DecoderState &state, FeederReport &report) {
+	memset(&state, 0, sizeof(state));
+	state.motion[0].direction = (int)(nextRandom(random) % 3) - 1;
+	state.motion[1].direction = (int)(nextRandom(random) % 3) - 1;
+
+	auto isKnob = isKnobDevice(deviceType);
+	auto range = isKnob ? MOTION_VALUE_POSITIVE + 1 : 256;
+
+	report.buttons = nextRandom(random) & 0xffff;
+	report.axisX = nextRandom(random) % range;
+	report.axisY = nextRandom(random) % range;
+	report.axisZ = isKnob ? 0 : nextRandom(random) % range;
+	if (nextRandom(random) % 8 == 0) {
+		report.axisX = range - 1;
+	}
+	report.frame = 0;
+	report.timestamp = 0;
+}
+
+static bool isSameReport(const FeederReport &a, const FeederReport &b) {
+	return a.buttons == b.buttons && a.axisX == b.axisX && a.axisY == b.axisY && a.axisZ == b.axisZ;
+}
+
+static void testRandomProfiles(RemapProfile &profile) {
+	uint32_t random = 0x9e3779b9;
+	auto checks = 0;
+	auto mismatches = 0;
+
+	for (auto profileIdx = 0; profileIdx < REMAP_TEST_PROFILES; profileIdx++) {
+		std::vector<RemapRule> rules(nextRandom(random) % REMAP_TEST_MAX_RULES);
+		for (auto &rule : rules) {
+			rule = getRandomRule(random);
+		}
+		compileRemapProfile(rules, profile);
+
+		for (auto deviceType = DeviceType::IIDX; deviceType < REMAP_DEVICE_TYPES; deviceType = (DeviceType)(deviceType + 1)) {
+			for (auto inputIdx = 0; inputIdx < REMAP_TEST_INPUTS; inputIdx++) {
+				DecoderState state;
+				FeederReport report;
+				getRandomInput(random, deviceType, state, report);
+
+				auto expected = report;
+				applyRemap(*getRemapTable(profile, deviceType), state, report);
+				interpretRules(rules, deviceType, state, expected);
+
+				checks++;
+				if (!isSameReport(report, expected)) {
+					mismatches++;
+				}
+			}
+		}
+	}
+
+	printf("random profiles: %d checks, %d differ from the interpreter\n", checks, mismatches);
+	CHECK(mismatches == 0);
+}
+
+// Pushing the turntable axis with buttons must leave the turntable working while they're released
+static void testPushedAxisPassesThrough(RemapProfile &profile) {
+	std::vector<RemapRule> rules = {
+		{ DeviceType::IIDX, REMAP_FROM_BUTTON, 8, 0, REMAP_TO_AXIS_POSITIVE, 0 },
+		{ DeviceType::IIDX, REMAP_FROM_BUTTON, 9, 0, REMAP_TO_AXIS_NEGATIVE, 0 },
+		{ DeviceType::SDVX, REMAP_FROM_AXIS, 0, 0, REMAP_TO_AXIS, 1 },
+		{ DeviceType::SDVX, REMAP_FROM_BUTTON, 0, 0, REMAP_TO_AXIS_NEGATIVE, 1 },
+	};
+	compileRemapProfile(rules, profile);
+
+	DecoderState state;
+	memset(&state, 0, sizeof(state));
+
+	auto table = getRemapTable(profile, DeviceType::IIDX);
+	FeederReport report = { 12345, 0, 0, 0, 0, 0 };
+	applyRemap(*table, state, report);
+	CHECK(report.axisX == 12345);
+
+	report = { 12345, 0, 0, 1u << 8, 0, 0 };
+	applyRemap(*table, state, report);
+	CHECK(report.axisX == MOTION_VALUE_POSITIVE);
+
+	// Both directions cancel out, but still take over the axis
+	report = { 12345, 0, 0, (1u << 8) | (1u << 9), 0, 0 };
+	applyRemap(*table, state, report);
+	CHECK(report.axisX == MOTION_VALUE_CENTER);
+
+	// A pushed axis that something is routed to shows the routed axis while released
+	table = getRemapTable(profile, DeviceType::SDVX);
+	report = { 777, 999, 0, 0, 0, 0 };
+	applyRemap(*table, state, report);
+	CHECK(report.axisY == 777);
+
+	report = { 777, 999, 0, 1, 0, 0 };
+	applyRemap(*table, state, report);
+	CHECK(report.axisY == MOTION_VALUE_NEGATIVE);
+}
+
+static bool loadProfileText(const char *text, RemapProfile &profile) {
+	auto file = openFile(L"remaptest_profile.txt", L"w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	fputs(text, file);
+	fclose(file);
+
+	auto ret = loadRemapProfile(L"remaptest_profile.txt", profile);
+	remove("remaptest_profile.txt");
+	return ret;
+}
+
+static void testProfileFiles(RemapProfile &profile) {
+	CHECK(loadProfileText(
+		"# Turntable as buttons\n"
+		"button 1 = button 3\n"
+		"button 2 = none # dropped\n"
+		"[iidx]\n"
+		"motion x- = button 8\n"
+		"motion x+ = button 9\n"
+		"button 9 = axis y+\n"
+		"axis x > 200 = button 12\n"
+		"axis x = axis z\n", profile));
+	CHECK(profile.isUsingMotion);
+
+	const char *invalidLines[] = {
+		"button 17 = button 1\n",
+		"button 1 = axis x\n",
+		"axis x = button 2\n",
+		"motion z+ = button 1\n",
+		"[foo]\n",
+		"axis y < 300 = button 1\n",
+		"button 1 button 2\n",
+	};
+	for (auto line : invalidLines) {
+		CHECK(!loadProfileText(line, profile));
+	}
+
+	// Paths that the C locale can't represent fail to open instead of turning into garbage
+	std::string narrowed;
+	CHECK(narrowPath(L"profile.txt", narrowed) && narrowed == "profile.txt");
+	CHECK(!narrowPath(L"\x00e9profile.txt", narrowed));
+	CHECK(openFile(L"\x00e9profile.txt", L"r") == nullptr);
+}
+
+static void benchmarkProfileSizes(RemapProfile &profile) {
+	uint32_t random = 0x2545f491;
+
+	std::vector<FeederReport> reports(REMAP_BENCHMARK_REPORTS);
+	std::vector<DecoderState> states(REMAP_BENCHMARK_REPORTS);
+	for (size_t i = 0; i < reports.size(); i++) {
+		getRandomInput(random, DeviceType::IIDX, states[i], reports[i]);
+	}
+
+	const int ruleCounts[] = { 0, 8, 64, 512, 4096 };
+	double smallestNs = 0.0;
+	double largestNs = 0.0;
+	volatile uint32_t sink = 0;
+
+	for (auto ruleCount : ruleCounts) {
+		std::vector<RemapRule> rules(ruleCount);
+		for (auto &rule : rules) {
+			rule = getRandomRule(random);
+		}
+		compileRemapProfile(rules, profile);
+		auto table = getRemapTable(profile, DeviceType::IIDX);
+
+		// Best of a few passes, a single core shared with other processes is noisy
+		auto bestNs = 0.0;
+		for (auto pass = 0; pass < REMAP_BENCHMARK_PASSES; pass++) {
+			auto start = getTimestampNs();
+			for (auto repeat = 0; repeat < 100; repeat++) {
+				for (size_t i = 0; i < reports.size(); i++) {
+					auto report = reports[i];
+					applyRemap(*table, states[i], report);
+					sink = sink + report.buttons + report.axisX;
+				}
+			}
+
+			auto ns = (double)(getTimestampNs() - start) / (100.0 * reports.size());
+			if (pass == 0 || ns < bestNs) {
+				bestNs = ns;
+			}
+		}
+
+		printf("%4d rules: %.2f ns/packet\n", ruleCount, bestNs);
+		if (ruleCount == 0) {
+			smallestNs = bestNs;
+		}
+		largestNs = bestNs;
+	}
+
+	CHECK(largestNs < smallestNs * 2.0 + 5.0);
+}
+
+int main() {
+	static RemapProfile profile;
+
+	testRandomProfiles(profile);
+	testPushedAxisPassesThrough(profile);
+	testProfileFiles(profile);
+	benchmarkProfileSizes(profile);
+
+	return CHECK_RESULT();
+}
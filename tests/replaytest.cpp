@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "capture.h"
+#include "check.h"
+#include "controller.h"
+#include "logger.h"
+#include "testcontroller.h"
+#include "timing.h"
+#include "xorshift.h"
+
+// Records a synthetic IIDX stream with jittered, batched arrivals, then checks that the capture reads
+// back byte for byte and that replaying it realtime or as fast as possible decodes to identical reports.
+
+#define REPLAY_NOTIFICATIONS 300
+#define REPLAY_BURST 3
+#define REPLAY_PACKET_LEN 5
+#define REPLAY_FRAME_NS 2000000ULL // Slower than a real controller so the realtime replay isn't too short to sleep in
+#define REPLAY_PATH L"replaytest.kcf" // Removed again by main
+
+struct ReplayTestContext {
+	Controller *controller;
+	DecoderConfig *config;
+	size_t notifications;
+};
+
+static void buildNotification(unsigned char *data, size_t notificationIdx) {
+	for (size_t packetIdx = 0; packetIdx < REPLAY_BURST; packetIdx++) {
+		auto packet = data + packetIdx * REPLAY_PACKET_LEN;
+		auto frame = notificationIdx * REPLAY_BURST + packetIdx;
+
+		packet[0] = (uint8_t)(frame * 5);
+		packet[1] = 0;
+		packet[2] = (uint8_t)((frame / 7) & 0x7f);
+		packet[3] = (uint8_t)((frame / 50) & 0x03);
+		packet[4] = (uint8_t)frame;
+	}
+}
+
+static bool replayCallback(void *context, const CaptureRecord &record) {
+	auto replay = (ReplayTestContext*)context;
+
+	unsigned char expected[REPLAY_BURST * REPLAY_PACKET_LEN];
+	buildNotification(expected, replay->notifications++);
+
+	CHECK(record.deviceType == DeviceType::IIDX);
+	CHECK(record.len == sizeof(expected));
+	CHECK(record.len == sizeof(expected) && memcmp(record.data, expected, sizeof(expected)) == 0);
+
+	processNotification(*replay->controller, *replay->config, record.data, record.len, record.timestamp, getTimestampNs());
+	return true;
+}
+
+static std::vector<FeederReport> replay(DecoderConfig &config, bool isRealtime) {
+	CaptureReader reader;
+	auto isOpen = openCaptureReader(reader, REPLAY_PATH);
+	CHECK(isOpen);
+	if (!isOpen) {
+		return std::vector<FeederReport>();
+	}
+
+	auto sink = new RecordingSink();
+	std::unique_ptr<Controller> controller(new Controller());
+	initTestController(*controller, DeviceType::IIDX, config, std::unique_ptr<OutputSink>(sink));
+
+	ReplayTestContext context = { controller.get(), &config, 0 };
+	auto stats = replayCapture(reader, isRealtime, replayCallback, &context);
+	closeCaptureReader(reader);
+
+	CHECK(stats.notifications == REPLAY_NOTIFICATIONS);
+	CHECK(context.notifications == REPLAY_NOTIFICATIONS);
+
+	// Replays start at different host times, only the timeline within a replay has to match
+	auto reports = sink->reports;
+	for (size_t i = 1; i < reports.size(); i++) {
+		reports[i].timestamp -= reports[0].timestamp;
+	}
+	if (!reports.empty()) {
+		reports[0].timestamp = 0;
+	}
+
+	return reports;
+}
+
+static bool isSameReport(const FeederReport &a, const FeederReport &b) {
+	return a.axisX == b.axisX && a.axisY == b.axisY && a.axisZ == b.axisZ && a.buttons == b.buttons && a.frame == b.frame && a.timestamp == b.timestamp;
+}
+
+int main() {
+	startLogger(LOG_OFF, false);
+
+	CaptureWriter writer;
+	CHECK(openCaptureWriter(writer, REPLAY_PATH));
+
+	// Notifications carry three frames and arrive up to 1.5 frames late
+	uint32_t random = 0x2468ace1;
+	uint64_t sampleTime = 1000000000ULL;
+	for (size_t i = 0; i < REPLAY_NOTIFICATIONS; i++) {
+		unsigned char data[REPLAY_BURST * REPLAY_PACKET_LEN];
+		buildNotification(data, i);
+
+		sampleTime += REPLAY_BURST * REPLAY_FRAME_NS;
+		auto arrival = sampleTime + nextRandom(random) % (REPLAY_FRAME_NS * 3 / 2);
+		writeCaptureRecord(writer, arrival, DeviceType::IIDX, 0, data, sizeof(data));
+	}
+	closeCaptureWriter(writer);
+
+	auto analogConfig = getDefaultDecoderConfig();
+	auto digitalConfig = analogConfig;
+	digitalConfig.isDigital = true;
+	digitalConfig.motionConfig.holdUs = 5000;
+
+	for (auto config : { &analogConfig, &digitalConfig }) {
+		auto fast = replay(*config, false);
+		auto fastAgain = replay(*config, false);
+		auto realtime = replay(*config, true);
+
+		CHECK(!fast.empty());
+		CHECK(fast.size() == fastAgain.size());
+		CHECK(fast.size() == realtime.size());
+
+		auto mismatches = 0;
+		for (size_t i = 0; i < fast.size() && i < fastAgain.size() && i < realtime.size(); i++) {
+			if (!isSameReport(fast[i], fastAgain[i]) || !isSameReport(fast[i], realtime[i])) {
+				mismatches++;
+			}
+		}
+
+		printf("%s: %zu reports, %d differ between fast and realtime replays\n", config->isDigital ? "digital" : "analog", fast.size(), mismatches);
+		CHECK(mismatches == 0);
+	}
+
+	remove("replaytest.kcf");
+	stopLogger();
+	return CHECK_RESULT();
+}
@@ -0,0 +1,153 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "sharedmemsink.h"
+#include "sharedstate.h"
+#include "timing.h"
+
+// One SharedMemorySink writer against several readers that map the region on their own and read it
+// with kcfReadSharedState, like an external tool would. Every field of a report is derived from its
+// update count, so any mix of two reports is a torn read.
+
+#define SEQLOCK_READERS 4
+#define SEQLOCK_WRITES 5000000ULL
+#define SEQLOCK_MIN_WRITES_PER_SEC 1000000.0 // Far below what the writer manages even with readers hammering the line
+
+struct ReaderStats {
+	uint64_t reads;
+	uint64_t failedReads;
+	uint64_t tornReads;
+	uint64_t missedUpdates;
+};
+
+static void fillReport(FeederReport &report, uint64_t updateCount) {
+	auto value = (uint32_t)updateCount;
+	report.axisX = (int32_t)value;
+	report.axisY = (int32_t)~value;
+	report.axisZ = (int32_t)(value >> 3);
+	report.buttons = value * 7u;
+	report.frame = (uint8_t)value;
+	report.timestamp = updateCount * 3;
+}
+
+static bool isConsistent(const KcfSharedState &state) {
+	if (state.updateCount == 0) {
+		return true;
+	}
+
+	FeederReport expected;
+	fillReport(expected, state.updateCount);
+
+	return state.axisX == expected.axisX
+		&& state.axisY == expected.axisY
+		&& state.axisZ == expected.axisZ
+		&& state.buttons == expected.buttons
+		&& state.frame == expected.frame
+		&& state.timestamp == expected.timestamp;
+}
+
+static void runReader(const volatile KcfSharedState *shared, const std::atomic<bool> &isDone, ReaderStats &stats) {
+	uint64_t lastUpdateCount = 0;
+
+	while (!isDone.load(std::memory_order_relaxed)) {
+		KcfSharedState state;
+		if (!kcfReadSharedState(shared, &state)) {
+			stats.failedReads++;
+			continue;
+		}
+
+		stats.reads++;
+
+		if (!isConsistent(state) || state.updateCount < lastUpdateCount || (state.sequence & 1) != 0) {
+			stats.tornReads++;
+		}
+		else if (state.updateCount > lastUpdateCount + 1) {
+			stats.missedUpdates += state.updateCount - lastUpdateCount - 1;
+		}
+
+		lastUpdateCount = state.updateCount;
+	}
+}
+
+int main() {
+	auto id = 1000 + (unsigned int)getpid() % 100000;
+	SharedMemorySink sink(id, DeviceType::IIDX);
+	CHECK(sink.isOpen());
+	if (!sink.isOpen()) {
+		return CHECK_RESULT();
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "/%s%u", KCF_SHARED_STATE_NAME_PREFIX, id);
+
+	auto fd = shm_open(name, O_RDONLY, 0);
+	CHECK(fd >= 0);
+	auto view = mmap(nullptr, sizeof(KcfSharedState), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	CHECK(view != MAP_FAILED);
+	if (view == MAP_FAILED) {
+		return CHECK_RESULT();
+	}
+
+	auto shared = (const volatile KcfSharedState*)view;
+	CHECK(shared->magic == KCF_SHARED_STATE_MAGIC);
+	CHECK(shared->version == KCF_SHARED_STATE_VERSION);
+	CHECK(shared->deviceType == DeviceType::IIDX);
+
+	std::atomic<bool> isDone(false);
+	std::vector<ReaderStats> stats(SEQLOCK_READERS, ReaderStats());
+	std::vector<std::thread> readers;
+	for (auto i = 0; i < SEQLOCK_READERS; i++) {
+		readers.push_back(std::thread(runReader, shared, std::cref(isDone), std::ref(stats[i])));
+	}
+
+	auto start = getTimestampNs();
+	for (uint64_t updateCount = 1; updateCount <= SEQLOCK_WRITES; updateCount++) {
+		FeederReport report;
+		fillReport(report, updateCount);
+		sink.submit(report);
+	}
+	auto elapsed = getTimestampNs() - start;
+
+	isDone.store(true);
+	for (auto &reader : readers) {
+		reader.join();
+	}
+
+	ReaderStats total = {};
+	for (auto &reader : stats) {
+		total.reads += reader.reads;
+		total.failedReads += reader.failedReads;
+		total.tornReads += reader.tornReads;
+		total.missedUpdates += reader.missedUpdates;
+	}
+
+	auto writesPerSec = SEQLOCK_WRITES / (elapsed / 1000000000.0);
+	printf("%.1fM writes/sec, %d readers: %llu reads, %llu gave up, %llu torn, %llu updates skipped between reads\n",
+		writesPerSec / 1000000.0,
+		SEQLOCK_READERS,
+		(unsigned long long)total.reads,
+		(unsigned long long)total.failedReads,
+		(unsigned long long)total.tornReads,
+		(unsigned long long)total.missedUpdates);
+
+	// A final read sees the last update
+	KcfSharedState state;
+	CHECK(kcfReadSharedState(shared, &state));
+	CHECK(state.updateCount == SEQLOCK_WRITES);
+	CHECK(isConsistent(state));
+
+	CHECK(total.reads > 0);
+	CHECK(total.tornReads == 0);
+	CHECK(writesPerSec >= SEQLOCK_MIN_WRITES_PER_SEC);
+
+	munmap(view, sizeof(KcfSharedState));
+	return CHECK_RESULT();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "controller.h"
+#include "output.h"
+
+// Keeps every report it gets
+class RecordingSink : public OutputSink {
+public:
+	bool submit(const FeederReport &report) override {
+		reports.push_back(report);
+		return true;
+	}
+
+	std::vector<FeederReport> reports;
+};
+
+// A controller that isn't connected to anything
+inline void initTestController(Controller &controller, DeviceType deviceType, const DecoderConfig &config, std::unique_ptr<OutputSink> sink) {
+	initController(controller, 0, 0, deviceType, 1, config);
+	setControllerOutput(controller, std::move(sink), true, false);
+}
+
+inline DecoderConfig getDefaultDecoderConfig() {
+	DecoderConfig config = { false, { { 1.0, 1.0, 0 }, { 1.0, 1.0, 0 } }, {}, { MOTION_DEFAULT_HYSTERESIS, MOTION_DEFAULT_HOLD_FRAMES, 0 }, nullptr, false };
+	buildDecoderTables(config);
+	return config;
+}
@@ -0,0 +1,388 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "check.h"
+#include "timing.h"
+#include "udpreceiver.h"
+#include "udpsink.h"
+#include "xorshift.h"
+
+// Reports streamed by UdpSink have to come out of UdpReceiver exactly as they went in, over IPv4 and
+// IPv6 loopback, and the receiver has to recover from lost, late, reordered and garbled datagrams,
+// including while the sender has nothing new to send and after the sender started over.
+
+#define UDP_TEST_REPORTS 2000
+#define UDP_TEST_LOSS_REPORTS 3000
+#define UDP_TEST_PACED_BURSTS 500 // One per millisecond like a real controller
+#define UDP_TEST_FLOOD_REPORTS 50000
+
+class BurstRecordingSink : public OutputSink {
+public:
+	BurstRecordingSink() : bursts(0) {
+	}
+
+	void beginBurst() override {
+		bursts++;
+	}
+
+	bool submit(const FeederReport &report) override {
+		reports.push_back(report);
+		return true;
+	}
+
+	std::vector<FeederReport> reports;
+	int bursts;
+};
+
+static OutputSink *getRecordingSink(void *context, unsigned int, DeviceType) {
+	return (OutputSink*)context;
+}
+
+static bool isSameState(const FeederReport &a, const FeederReport &b) {
+	return a.axisX == b.axisX && a.axisY == b.axisY && a.axisZ == b.axisZ && a.buttons == b.buttons && a.frame == b.frame;
+}
+
+// Ports that another run of the tests on the same machine won't pick
+static uint16_t getTestPort(int idx) {
+	return (uint16_t)(20000 + (getpid() % 4000) * 8 + idx);
+}
+
+static void drainSocket(UdpSocket &socket, UdpReceiver &receiver, int timeoutMs) {
+	uint8_t datagram[KCF_UDP_MAX_DATAGRAM_LEN];
+	int len;
+	while ((len = socket.receive(datagram, sizeof(datagram), timeoutMs)) > 0) {
+		receiver.processDatagram(datagram, len, getTimestampNs());
+	}
+}
+
+static void testLoopback(const char *host, uint16_t port) {
+	UdpSocket socket;
+	CHECK(socket.bind(port));
+
+	UdpSink sink(host, port, 3, DeviceType::IIDX, UDP_DEFAULT_KEYFRAME_INTERVAL_MS);
+	if (!sink.isOpen()) {
+		printf("%s: can't send, skipped\n", host);
+		return;
+	}
+
+	BurstRecordingSink recorded;
+	UdpReceiver receiver(getRecordingSink, &recorded, true);
+
+	uint32_t random = 0x2545f491;
+	std::vector<FeederReport> sent;
+	auto bursts = 0;
+	FeederReport report = {};
+
+	while (sent.size() < UDP_TEST_REPORTS) {
+		auto burst = 1 + nextRandom(random) % 4;
+		sink.beginBurst();
+		for (uint32_t i = 0; i < burst; i++) {
+			if (nextRandom(random) % 4 == 0) {
+				report.axisX = nextRandom(random) % 32769;
+			}
+			if (nextRandom(random) % 3 == 0) {
+				report.buttons = nextRandom(random) & 0x3ff;
+			}
+			report.axisY = MOTION_VALUE_CENTER;
+			report.frame++;
+			report.timestamp = getTimestampNs() - 500000;
+
+			sent.push_back(report);
+			sink.submit(report);
+		}
+		sink.endBurst();
+		bursts++;
+
+		drainSocket(socket, receiver, 0);
+	}
+	drainSocket(socket, receiver, 50);
+
+	auto mismatches = 0;
+	for (size_t i = 0; i < sent.size() && i < recorded.reports.size(); i++) {
+		mismatches += isSameState(sent[i], recorded.reports[i]) ? 0 : 1;
+	}
+
+	auto stats = receiver.getStreamStats(3);
+	auto snapshot = getMetricsSnapshot(*receiver.getStreamMetrics(3));
+	printf("%s: %zu reports in %llu datagrams, %zu received, %d differ, %d bursts, latency p50 %.1fus including 500us of sample age\n",
+		host, sent.size(), (unsigned long long)sink.datagrams, recorded.reports.size(), mismatches, recorded.bursts, snapshot.latencyP50 / 1000.0);
+
+	CHECK(recorded.reports.size() == sent.size());
+	CHECK(mismatches == 0);
+	CHECK(recorded.bursts == bursts);
+	CHECK(stats != nullptr && stats->lostDatagrams == 0);
+}
+
+static void testIdleKeyframes(uint16_t port) {
+	UdpSocket socket;
+	CHECK(socket.bind(port));
+
+	UdpSink sink("127.0.0.1", port, 5, DeviceType::POPN, 1);
+	BurstRecordingSink recorded;
+	UdpReceiver receiver(getRecordingSink, &recorded, true);
+
+	// Nothing to repeat before the first report
+	sink.sendIdleKeyframe();
+	CHECK(sink.datagrams == 0);
+
+	FeederReport report = { 10, 20, 30, 1, 1, getTimestampNs() };
+	sink.submit(report);
+	drainSocket(socket, receiver, 50);
+
+	// The button release is lost, and while the button stays released nothing else is reported
+	report.buttons = 0;
+	report.frame = 2;
+	sink.submit(report);
+	uint8_t datagram[KCF_UDP_MAX_DATAGRAM_LEN];
+	CHECK(socket.receive(datagram, sizeof(datagram), 50) > 0);
+
+	FeederReport state;
+	CHECK(receiver.getState(5, state) && state.buttons == 1);
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	sink.sendIdleKeyframe();
+	sink.sendIdleKeyframe(); // Too soon for another one
+	drainSocket(socket, receiver, 50);
+
+	auto stats = receiver.getStreamStats(5);
+	auto snapshot = getMetricsSnapshot(*receiver.getStreamMetrics(5));
+	CHECK(receiver.getState(5, state) && isSameState(state, report));
+	CHECK(sink.datagrams == 3);
+	CHECK(stats->idleKeyframes == 1);
+	CHECK(stats->reports == 1); // The repeat isn't a new report, nor a frame or a latency sample
+	CHECK(stats->lostDatagrams == 1);
+	CHECK(snapshot.latencyCount == 1);
+	CHECK(snapshot.droppedFrames == 0);
+}
+
+static void testLossAndReordering(uint16_t port) {
+	UdpSocket socket;
+	CHECK(socket.bind(port));
+
+	// Capture real datagrams first, with a pause now and then so the keyframe interval kicks in as well
+	UdpSink sink("127.0.0.1", port, 4, DeviceType::SDVX, 20);
+	std::vector<std::vector<uint8_t>> datagrams;
+	std::vector<FeederReport> sent;
+	FeederReport report = {};
+
+	for (auto n = 0; n < UDP_TEST_LOSS_REPORTS; n++) {
+		report.axisX = (report.axisX + 37) % 32769;
+		if (n % 7 == 0) {
+			report.buttons ^= 1u << (n % 10);
+		}
+		report.frame++;
+		report.timestamp = getTimestampNs();
+
+		sink.submit(report);
+		sent.push_back(report);
+
+		uint8_t datagram[KCF_UDP_MAX_DATAGRAM_LEN];
+		auto len = socket.receive(datagram, sizeof(datagram), 100);
+		CHECK(len > 0);
+		datagrams.push_back(std::vector<uint8_t>(datagram, datagram + (len > 0 ? len : 0)));
+
+		if (n % 100 == 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(25));
+		}
+	}
+
+	// Drop one in 20 and swap one pair in 100, everything that gets applied has to be exactly what was sent
+	BurstRecordingSink recorded;
+	UdpReceiver receiver(getRecordingSink, &recorded, true);
+
+	std::vector<size_t> order;
+	for (size_t i = 0; i < datagrams.size(); i++) {
+		order.push_back(i);
+	}
+
+	uint32_t random = 0x9e3779b9;
+	auto swapped = 0;
+	for (size_t i = 0; i + 1 < order.size(); i++) {
+		if (nextRandom(random) % 100 == 0) {
+			std::swap(order[i], order[i + 1]);
+			swapped++;
+			i++;
+		}
+	}
+
+	auto dropped = 0;
+	auto correct = 0;
+	auto wrong = 0;
+	for (auto i : order) {
+		if (i + 1 < datagrams.size() && nextRandom(random) % 20 == 0) {
+			dropped++;
+			continue;
+		}
+
+		auto before = recorded.reports.size();
+		receiver.processDatagram(datagrams[i].data(), datagrams[i].size(), getTimestampNs());
+		if (recorded.reports.size() > before) {
+			(isSameState(recorded.reports.back(), sent[i]) ? correct : wrong)++;
+		}
+	}
+
+	// Garbage and a truncated datagram are rejected without touching the state
+	uint8_t junk[40] = {};
+	CHECK(!receiver.processDatagram(junk, sizeof(junk), 0));
+	CHECK(!receiver.processDatagram(datagrams[5].data(), datagrams[5].size() - 1, 0));
+
+	auto stats = receiver.getStreamStats(4);
+	printf("loss: %zu datagrams, %d dropped, %d pairs swapped, %llu lost, %llu late, %llu reports skipped, %llu keyframes, %d applied, %d wrong\n",
+		datagrams.size(), dropped, swapped, (unsigned long long)stats->lostDatagrams, (unsigned long long)stats->lateDatagrams,
+		(unsigned long long)stats->skippedReports, (unsigned long long)stats->keyframes, correct, wrong);
+
+	FeederReport state;
+	CHECK(wrong == 0);
+	CHECK(correct > UDP_TEST_LOSS_REPORTS * 3 / 4);
+	CHECK(receiver.malformedDatagrams == 2);
+	CHECK(stats->lateDatagrams >= (uint64_t)swapped / 2);
+	CHECK(receiver.getState(4, state) && isSameState(state, sent.back()));
+}
+
+static void testRestart(uint16_t port) {
+	UdpSocket socket;
+	CHECK(socket.bind(port));
+
+	// Two runs of the same sender, the second one starts its sequence over from 0
+	std::vector<std::vector<uint8_t>> runs[2];
+	FeederReport report = {};
+	for (auto run = 0; run < 2; run++) {
+		UdpSink sink("127.0.0.1", port, 5, DeviceType::IIDX, UDP_DEFAULT_KEYFRAME_INTERVAL_MS);
+		for (auto n = 0; n < 50; n++) {
+			report.axisX = run * 1000 + n;
+			report.frame++;
+			report.timestamp = getTimestampNs();
+			sink.submit(report);
+
+			uint8_t datagram[KCF_UDP_MAX_DATAGRAM_LEN];
+			auto len = socket.receive(datagram, sizeof(datagram), 100);
+			CHECK(len > 0);
+			runs[run].push_back(std::vector<uint8_t>(datagram, datagram + (len > 0 ? len : 0)));
+		}
+	}
+
+	BurstRecordingSink recorded;
+	UdpReceiver receiver(getRecordingSink, &recorded, true);
+	for (auto &datagram : runs[0]) {
+		receiver.processDatagram(datagram.data(), datagram.size(), getTimestampNs());
+	}
+
+	// The new run is picked up from its first keyframe, a late delta of the old run doesn't touch it and
+	// a repeat of the keyframe is still late within the new run
+	FeederReport state;
+	receiver.processDatagram(runs[1][0].data(), runs[1][0].size(), getTimestampNs());
+	CHECK(receiver.getState(5, state) && state.axisX == 1000);
+	receiver.processDatagram(runs[0][45].data(), runs[0][45].size(), getTimestampNs());
+	receiver.processDatagram(runs[1][0].data(), runs[1][0].size(), getTimestampNs());
+	CHECK(receiver.getState(5, state) && state.axisX == 1000);
+
+	for (size_t i = 1; i < runs[1].size(); i++) {
+		receiver.processDatagram(runs[1][i].data(), runs[1][i].size(), getTimestampNs());
+	}
+
+	auto stats = receiver.getStreamStats(5);
+	printf("restart: %llu restarts, %llu late, %llu lost, %llu reports skipped\n", (unsigned long long)stats->restarts,
+		(unsigned long long)stats->lateDatagrams, (unsigned long long)stats->lostDatagrams, (unsigned long long)stats->skippedReports);
+
+	CHECK(stats->restarts == 1);
+	CHECK(stats->lateDatagrams == 1);
+	CHECK(stats->lostDatagrams == 0);
+	CHECK(stats->skippedReports == 1);
+	CHECK(recorded.reports.size() == 100);
+	CHECK(receiver.getState(5, state) && state.axisX == 1049);
+}
+
+static void testThroughput(uint16_t port, int burst) {
+	UdpSocket socket;
+	CHECK(socket.bind(port));
+
+	UdpReceiver receiver(nullptr, nullptr, true);
+	std::atomic<bool> isDone(false);
+	std::thread receiverThread([&]() {
+		uint8_t datagram[KCF_UDP_MAX_DATAGRAM_LEN];
+		for (;;) {
+			auto len = socket.receive(datagram, sizeof(datagram), 200);
+			if (len > 0) {
+				receiver.processDatagram(datagram, len, getTimestampNs());
+			}
+			else if (isDone.load()) {
+				break;
+			}
+		}
+	});
+
+	UdpSink sink("127.0.0.1", port, 1, DeviceType::IIDX, 1);
+	FeederReport report = {};
+
+	auto start = getTimestampNs();
+	for (auto n = 0; n < UDP_TEST_PACED_BURSTS; n++) {
+		while (getTimestampNs() - start < (uint64_t)n * 1000000) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		sink.beginBurst();
+		for (auto i = 0; i < burst; i++) {
+			report.axisX = (report.axisX + 100) % 32769;
+			report.buttons = (n / 50) & 0x7f;
+			report.frame++;
+			report.timestamp = getTimestampNs();
+			sink.submit(report);
+		}
+		sink.endBurst();
+	}
+
+	// Wait for the paced part to be received before looking at its latency
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	auto paced = getMetricsSnapshot(*receiver.getStreamMetrics(1));
+
+	auto flood = UDP_TEST_FLOOD_REPORTS / burst;
+	start = getTimestampNs();
+	for (auto n = 0; n < flood; n++) {
+		sink.beginBurst();
+		for (auto i = 0; i < burst; i++) {
+			report.axisX = (report.axisX + 100) % 32769;
+			report.frame++;
+			report.timestamp = getTimestampNs();
+			sink.submit(report);
+		}
+		sink.endBurst();
+	}
+	auto elapsed = getTimestampNs() - start;
+
+	// Whatever the flood lost, the state is repeated once the sender goes idle
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	sink.sendIdleKeyframe();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	isDone.store(true);
+	receiverThread.join();
+
+	auto stats = receiver.getStreamStats(1);
+	printf("burst %d: paced latency p50 %.1fus p99 %.1fus max %.1fus, flood %.0f reports/s in %.0f datagrams/s, %llu datagrams lost\n",
+		burst, paced.latencyP50 / 1000.0, paced.latencyP99 / 1000.0, paced.latencyMax / 1000.0,
+		flood * burst / (elapsed / 1e9), flood / (elapsed / 1e9), (unsigned long long)stats->lostDatagrams);
+
+	FeederReport state;
+	CHECK(paced.latencyCount == (uint64_t)(UDP_TEST_PACED_BURSTS * burst));
+	CHECK(stats->reports <= (uint64_t)((UDP_TEST_PACED_BURSTS + flood) * burst));
+	CHECK(receiver.getState(1, state) && isSameState(state, report));
+}
+
+int main() {
+	testLoopback("127.0.0.1", getTestPort(0));
+	testLoopback("::1", getTestPort(1));
+	testIdleKeyframes(getTestPort(2));
+	testLossAndReordering(getTestPort(3));
+	testRestart(getTestPort(5));
+
+	const int bursts[] = { 1, 4, 8 };
+	for (auto burst : bursts) {
+		testThroughput(getTestPort(4), burst);
+	}
+
+	return CHECK_RESULT();
+}